@@ -0,0 +1,253 @@
+import std;
+import vis;
+
+namespace {
+
+constexpr int FRAME_COUNT = 100;
+constexpr int SCREEN_WIDTH = 800;
+constexpr int SCREEN_HEIGHT = 600;
+constexpr std::array ENTITY_COUNTS = {1'000, 10'000, 100'000};
+constexpr int PHYSICS_BODY_COUNT = 12'000;
+constexpr int PHYSICS_STEP_COUNT = 120;
+
+vis::opengl::Program build_program(std::string_view vertex_source,
+																	 std::string_view fragment_source = vis::shaders::color_fragment) {
+	auto program = vis::opengl::ProgramBuilder{}
+										 .add_shader(vis::opengl::Shader::create(vis::opengl::ShaderType::vertex, vertex_source))
+										 .add_shader(vis::opengl::Shader::create(vis::opengl::ShaderType::fragment, fragment_source))
+										 .build();
+
+	if (not program) {
+		throw std::runtime_error{"Unable to build the benchmark program"};
+	}
+
+	return std::move(*program);
+}
+
+void populate(vis::ecs::registry& registry, int entity_count, vis::vec2 half_world_extent) {
+	std::mt19937 rng{42};
+	std::uniform_real_distribution<float> x{-half_world_extent.x, half_world_extent.x};
+	std::uniform_real_distribution<float> y{-half_world_extent.y, half_world_extent.y};
+	std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+
+	for (int i = 0; i != entity_count; ++i) {
+		const auto entity = registry.create();
+		const float radius = 0.05f + 0.1f * unit(rng);
+		registry.emplace<vis::physics::Transformation>(entity, vis::physics::Transformation{
+																															 .position = vis::vec2{x(rng), y(rng)},
+																															 .scale = vis::vec2{radius, radius},
+																															 .rotation = {1.0f, 0.0f},
+																													 });
+		registry.emplace<vis::mesh::Color>(entity, vis::vec4{unit(rng), unit(rng), unit(rng), 1.0f});
+	}
+}
+
+// Average wall time of a frame, glFinish included so the GPU work is accounted too
+template <typename RenderFrame> double time_frames(vis::engine::Engine& engine, RenderFrame&& render_frame) {
+	const auto run_frame = [&] {
+		engine.clear();
+		render_frame();
+		vis::opengl::renderer_finish();
+		vis::opengl::state_cache().end_frame();
+	};
+
+	run_frame();
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int frame = 0; frame != FRAME_COUNT; ++frame) {
+		run_frame();
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+
+	return std::chrono::duration<double, std::milli>(elapsed).count() / FRAME_COUNT;
+}
+
+// Average time of a world step with `worker_count` threads, on a pile of dynamic balls falling in a closed box
+double time_physics_steps(std::uint32_t worker_count) {
+	constexpr auto time_step = 1.0f / 60.0f;
+	constexpr auto half_extent = 40.0f;
+	constexpr auto radius = 0.25f;
+
+	vis::tasks::TaskSystem tasks{worker_count};
+	auto world_def = vis::physics::WorldDef();
+	world_def.set_gravity(vis::vec2{0.0f, -9.81f});
+	world_def.set_task_system(tasks);
+	auto world = vis::physics::create_world(world_def);
+	std::vector<vis::physics::RigidBody> bodies; // the bodies are destroyed with their handle
+
+	const auto add_wall = [&](vis::vec2 position, vis::vec2 wall_half_extent) {
+		vis::physics::RigidBodyDef body_def;
+		body_def.set_position(position).set_body_type(vis::physics::BodyType::fixed);
+		bodies.push_back(world->create_body(body_def));
+		bodies.back().create_shape(vis::physics::ShapeDef{}, vis::physics::create_box2d(wall_half_extent));
+	};
+	add_wall(vis::vec2{0.0f, -half_extent}, vis::vec2{half_extent, 1.0f});
+	add_wall(vis::vec2{-half_extent, 0.0f}, vis::vec2{1.0f, half_extent});
+	add_wall(vis::vec2{+half_extent, 0.0f}, vis::vec2{1.0f, half_extent});
+
+	// a grid of balls, slightly jittered so they don't stack in columns
+	std::mt19937 rng{42};
+	std::uniform_real_distribution<float> jitter{-0.05f, 0.05f};
+	constexpr auto columns = 120;
+	for (int i = 0; i != PHYSICS_BODY_COUNT; ++i) {
+		const auto position = vis::vec2{-half_extent + 2.0f + static_cast<float>(i % columns) * 0.6f + jitter(rng),
+																		-half_extent + 2.0f + static_cast<float>(i / columns) * 0.6f};
+		vis::physics::RigidBodyDef body_def;
+		body_def.set_position(position).set_body_type(vis::physics::BodyType::dynamic);
+		bodies.push_back(world->create_body(body_def));
+		bodies.back().create_shape(vis::physics::ShapeDef{}, vis::physics::Circle{.radius = radius});
+	}
+
+	world->step(time_step, 4);
+
+	const auto start = std::chrono::steady_clock::now();
+	for (int step = 0; step != PHYSICS_STEP_COUNT; ++step) {
+		world->step(time_step, 4);
+	}
+	const auto elapsed = std::chrono::steady_clock::now() - start;
+
+	return std::chrono::duration<double, std::milli>(elapsed).count() / PHYSICS_STEP_COUNT;
+}
+
+void report(int entity_count, std::string_view path, double frame_ms, std::string_view notes = {}) {
+	const auto& state = vis::engine::Engine::state_stats();
+	std::println("{:>10} | {:<12} | {:>10.3f} | {:>10} | {:>10} | {}", entity_count, path, frame_ms, state.issued,
+							 state.elided, notes);
+}
+
+} // namespace
+
+int main() {
+	auto engine = vis::engine::create_headless(vis::engine::HeadlessOptions{
+			.width = SCREEN_WIDTH,
+			.height = SCREEN_HEIGHT,
+	});
+	engine.print_info();
+	engine.set_viewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+	const auto screen_proj = vis::orthogonal_matrix(SCREEN_WIDTH, SCREEN_HEIGHT, 20.0f, 20.0f);
+	auto per_entity_program = build_program(vis::shaders::mesh_vertex);
+	auto instanced_program = build_program(vis::shaders::instanced_vertex);
+	const auto model_view_projection = per_entity_program.uniform<vis::mat4>("model_view_projection");
+	const auto view_projection = instanced_program.uniform<vis::mat4>("view_projection");
+	auto circle_program = build_program(vis::shaders::instanced_circle_vertex, vis::shaders::circle_fragment);
+	const auto circle_view_projection = circle_program.uniform<vis::mat4>("view_projection");
+
+	vis::mesh::MeshLibrary mesh_library;
+	const auto& unit_circle = mesh_library.regular_shape(20);
+	const auto& circle_quad = mesh_library.circle();
+	vis::mesh::InstanceBuffer instance_buffer;
+	std::vector<vis::mesh::InstanceData> instances;
+	vis::batch::ShapeBatcher shape_batcher;
+	vis::render::MultiDrawRenderer multi_draw;
+
+	std::println("{:>10} | {:<12} | {:>10} | {:>10} | {:>10} | {}", "entities", "path", "frame [ms]", "gl issued",
+							 "gl elided", "notes");
+	for (const auto entity_count : ENTITY_COUNTS) {
+		vis::ecs::registry registry;
+		populate(registry, entity_count, screen_proj.half_world_extent);
+		const auto view = registry.view<const vis::physics::Transformation, const vis::mesh::Color>();
+
+		report(entity_count, "per entity", time_frames(engine, [&] {
+			per_entity_program.use();
+			view.each([&](const auto& transformation, const auto&) {
+				per_entity_program.set(model_view_projection, screen_proj.projection * transformation.get_model());
+				unit_circle.draw(per_entity_program);
+			});
+		}));
+
+		// part of every frame timed below, the instances are gathered and uploaded again each time
+		const auto upload_instances = [&] {
+			instances.clear();
+			view.each([&](const auto& transformation, const auto& color) {
+				const auto& [position, scale, rotation] = transformation;
+				instances.push_back(vis::mesh::InstanceData{
+						.transform = vis::vec4{position, rotation.cos_angle, rotation.sin_angle},
+						.scale = scale,
+						.color = color.value,
+				});
+			});
+			instance_buffer.upload(instances);
+		};
+
+		report(entity_count, "instanced", time_frames(engine, [&] {
+			upload_instances();
+			instanced_program.use();
+			instanced_program.set(view_projection, screen_proj.projection);
+			unit_circle.draw_instanced(instanced_program, instance_buffer);
+		}));
+
+		// same instances, 4 vertexes per circle instead of 21
+		report(entity_count, "sdf circles", time_frames(engine, [&] {
+			upload_instances();
+			circle_program.use();
+			circle_program.set(circle_view_projection, screen_proj.projection);
+			circle_quad.draw_instanced(circle_program, instance_buffer);
+		}));
+
+		report(entity_count, "render queue", time_frames(engine, [&] {
+			engine.begin_frame(screen_proj.projection);
+			auto& render_queue = engine.render_queue();
+			view.each([&](const auto& transformation, const auto& color) {
+				const auto& [position, scale, rotation] = transformation;
+				render_queue.submit(0, instanced_program, view_projection, unit_circle,
+														vis::mesh::InstanceData{
+																.transform = vis::vec4{position, rotation.cos_angle, rotation.sin_angle},
+																.scale = scale,
+																.color = color.value,
+														});
+			});
+			render_queue.execute();
+		}));
+
+		const auto multi_draw_ms = time_frames(engine, [&] {
+			multi_draw.begin_frame();
+			view.each([&](const auto& transformation, const auto& color) {
+				const auto& [position, scale, rotation] = transformation;
+				multi_draw.submit(unit_circle, vis::mesh::InstanceData{
+																					 .transform = vis::vec4{position, rotation.cos_angle, rotation.sin_angle},
+																					 .scale = scale,
+																					 .color = color.value,
+																			 });
+			});
+
+			instanced_program.use();
+			instanced_program.set(view_projection, screen_proj.projection);
+			multi_draw.execute(instanced_program);
+		});
+		report(entity_count, "multi draw", multi_draw_ms,
+					 std::format("{} draw calls, {}", multi_draw.draw_calls(),
+											 multi_draw.uses_multi_draw_indirect() ? "indirect" : "4.1 fallback"));
+
+		const auto batched_ms = time_frames(engine, [&] {
+			shape_batcher.begin_frame();
+			view.each([&](const auto& transformation, const auto& color) {
+				shape_batcher.submit(unit_circle, transformation, color.value);
+			});
+
+			per_entity_program.use();
+			per_entity_program.set(model_view_projection, screen_proj.projection);
+			shape_batcher.flush(per_entity_program);
+		});
+		const auto& batch_stats = shape_batcher.stats();
+		report(entity_count, "batched", batched_ms,
+					 std::format("{} vertices, {:.2f} MiB streamed", batch_stats.vertices,
+											 static_cast<double>(batch_stats.bytes) / (1024.0 * 1024.0)));
+	}
+
+	std::println("");
+	std::println("{:>10} | {:>8} | {:>10} | {}", "bodies", "workers", "step [ms]", "speedup");
+	const auto max_workers = std::min(std::max(1u, std::thread::hardware_concurrency()), vis::physics::max_workers);
+	double single_worker_ms = 0.0;
+	for (std::uint32_t workers = 1;; workers = std::min(workers * 2, max_workers)) {
+		const auto step_ms = time_physics_steps(workers);
+		single_worker_ms = workers == 1 ? step_ms : single_worker_ms;
+		std::println("{:>10} | {:>8} | {:>10.3f} | {:.2f}x", PHYSICS_BODY_COUNT, workers, step_ms,
+								 single_worker_ms / step_ms);
+		if (workers == max_workers) {
+			break;
+		}
+	}
+
+	return 0;
+}
@@ -15,14 +15,107 @@ export {
 
 	struct Ball {};
 
+	struct BallSpawn {
+		float radius;
+		vis::vec2 position;
+		vis::vec2 velocity;
+		vis::vec4 color;
+		bool is_bullet = true;
+	};
+
+	enum class RenderMode {
+		instanced,
+		batched,
+		multi_draw,
+	};
+
+	constexpr std::string_view render_mode_name(RenderMode mode) {
+		switch (mode) {
+		case RenderMode::instanced:
+			return "instanced";
+		case RenderMode::batched:
+			return "batched";
+		case RenderMode::multi_draw:
+			return "multi draw";
+		}
+		std::unreachable();
+	}
+
 	constexpr int SCREEN_HEIGHT = 600;
 	constexpr std::ratio<4, 3> ASPECT_RATIO;
 	constexpr int SCREEN_WIDTH = 800; // SCREEN_HEIGHT * ASPECT_RATIO.num / ASPECT_RATIO.den;
 
+	// Command line: [--headless] [--read-back] [--frames=N] [--balls=N] [--trace=FILE] [--shader-cache=DIR]
+	//               [--physics-rate=HZ] [--workers=N] [--churn=N] [--no-sleep]
+	struct Options {
+		bool headless = false;
+		bool read_back = false;
+		bool sleep = true; // resting bodies leave the solver
+		int frame_count = 0; // 0 runs until the app is closed
+		int ball_count = 0;
+		int physics_rate = 30; // steps per second, the rendering interpolates in between
+		int workers = 0; // threads stepping the physics, 0 uses every core
+		int churn = 0; // balls despawned and spawned again every frame
+		std::string trace_path; // the last frames are written there as a Chrome trace when the app quits
+		std::string shader_cache = "shader_cache"; // program binaries, empty always compiles the shaders
+
+		static Options parse(std::span<char*> args) {
+			Options options;
+			const auto parse_int = [](std::string_view value, int& out) {
+				const auto [_, error] = std::from_chars(value.data(), value.data() + value.size(), out);
+				if (error != std::errc{}) {
+					throw std::runtime_error{std::format("Invalid number: {}", value)};
+				}
+			};
+
+			for (const std::string_view arg : args.subspan(std::min<std::size_t>(1, args.size()))) {
+				if (arg == "--headless") {
+					options.headless = true;
+				} else if (arg == "--no-sleep") {
+					options.sleep = false;
+				} else if (arg == "--read-back") {
+					options.read_back = true;
+				} else if (arg.starts_with("--frames=")) {
+					parse_int(arg.substr(arg.find('=') + 1), options.frame_count);
+				} else if (arg.starts_with("--balls=")) {
+					parse_int(arg.substr(arg.find('=') + 1), options.ball_count);
+				} else if (arg.starts_with("--physics-rate=")) {
+					parse_int(arg.substr(arg.find('=') + 1), options.physics_rate);
+					options.physics_rate = std::max(options.physics_rate, 1);
+				} else if (arg.starts_with("--churn=")) {
+					parse_int(arg.substr(arg.find('=') + 1), options.churn);
+					options.churn = std::max(options.churn, 0);
+				} else if (arg.starts_with("--workers=")) {
+					parse_int(arg.substr(arg.find('=') + 1), options.workers);
+					options.workers = std::max(options.workers, 0);
+				} else if (arg.starts_with("--trace=")) {
+					options.trace_path = arg.substr(arg.find('=') + 1);
+				} else if (arg.starts_with("--shader-cache=")) {
+					options.shader_cache = arg.substr(arg.find('=') + 1);
+				} else {
+					std::println("Unknown option: {}", arg);
+				}
+			}
+
+			return options;
+		}
+	};
+
 	class App {
 	public:
-		static App* create() {
+		static App* create(std::span<char*> args) {
 			srand(SDL_GetTicks());
+			const auto options = Options::parse(args);
+
+			if (options.headless) {
+				static auto engine = vis::engine::create_headless(vis::engine::HeadlessOptions{
+						.width = SCREEN_WIDTH,
+						.height = SCREEN_HEIGHT,
+						.read_back = options.read_back,
+				});
+				return new App{nullptr, engine, options};
+			}
+
 			static SDL_Window* window = SDL_CreateWindow("Hello OpenGL", SCREEN_WIDTH, SCREEN_HEIGHT, screen_flags);
 
 			if (not window) {
@@ -30,11 +123,20 @@ export {
 			}
 
 			static auto engine = vis::engine::create(window);
-			return new App{window, engine};
+			return new App{window, engine, options};
 		}
 
 		~App() {
-			SDL_DestroyWindow(window);
+			// the world is gone before the registry, its bodies with it
+			entity_registry.on_destroy<vis::physics::RigidBody>().disconnect(this);
+
+			if (not options.trace_path.empty()) {
+				vis::profile::write_chrome_trace(options.trace_path, trace_frames);
+			}
+
+			if (window) {
+				SDL_DestroyWindow(window);
+			}
 		}
 
 		[[nodiscard]] SDL_AppResult processEvent(const SDL_Event* event) noexcept {
@@ -51,23 +153,40 @@ export {
 				case SDLK_R:
 					break;
 
-				case SDLK_SPACE: {
-					auto get_random = [](float min = 0.0f, float max = 1.0f) -> float {
-						auto r = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
-						return (max - min) * r + min;
-					};
-
-					const float radius = get_random(.5f, 2.0f);
-					const auto col = vis::vec4{
-							get_random(),
-							get_random(),
-							get_random(),
-							1.0f,
-					};
-					const auto vel = vis::vec2{get_random(-10.0f, 10.0f), get_random(-10.0f, 10.0f)};
-					const auto pos = vis::vec2{get_random(-10.0, 10.0f), 8.0f};
-					add_ball(radius, pos, vel, col);
+				case SDLK_I: {
+					const auto& state = engine.state_stats();
+					std::println("GL state changes last frame: {} issued, {} elided", state.issued, state.elided);
+					const auto timings = engine.timings();
+					std::println("GPU clear {:.3f} ms, scene {:.3f} ms, present {:.3f} ms | CPU scene {:.3f} ms",
+											 timings.gpu_clear_ms, timings.gpu_scene_ms, timings.gpu_present_ms, timings.cpu_scene_ms);
+					std::println("Drawn {} of {} shapes", visible_count, entity_registry.view<vis::mesh::MeshRef>().size());
+					std::println("{} awake bodies", entity_registry.view<vis::physics::Awake>().size());
+					std::println("Contacts: {} begun, {} ended, {} hits", snapshot->contacts.begun, snapshot->contacts.ended,
+											 snapshot->contacts.hits);
 				} break;
+
+				case SDLK_P:
+					vis::profile::write_chrome_trace("trace.json", trace_frames);
+					break;
+
+				case SDLK_B:
+					render_mode = static_cast<RenderMode>((std::to_underlying(render_mode) + 1) % render_mode_count);
+					std::println("Render mode: {}", render_mode_name(render_mode));
+					break;
+
+				case SDLK_SPACE:
+					add_random_ball();
+					break;
+
+				case SDLK_M:
+					add_random_balls(mass_spawn_count);
+					std::println("{} balls", entity_registry.view<Ball>().size());
+					break;
+
+				case SDLK_D:
+					despawn_balls(mass_spawn_count);
+					std::println("{} balls", entity_registry.view<Ball>().size());
+					break;
 				default:
 					break;
 				}
@@ -80,6 +199,7 @@ export {
 				screen_height = event->window.data2;
 				engine.set_viewport(0, 0, screen_width, screen_height);
 				screen_proj = vis::orthogonal_matrix(screen_width, screen_height, 20.0f, 20.0f);
+				simulation->set_camera(camera());
 			}
 
 			return SDL_AppResult::SDL_APP_CONTINUE;
@@ -90,29 +210,45 @@ export {
 		}
 
 		[[nodiscard]] SDL_AppResult update() noexcept {
+			vis::profile::begin_frame();
+			const auto scope = vis::profile::Scope{"App::update"};
 
-			static float previous_time = SDL_GetTicks() / 1000.0f;
-			engine.clear();
-
-			const auto t = SDL_GetTicks() / 1000.0f;
-			const auto dt = t - previous_time;
+			if (options.churn != 0) {
+				despawn_balls(static_cast<std::size_t>(options.churn));
+				add_random_balls(options.churn);
+			}
+			sync_simulation();
 
-			update_physic_system(t, dt);
-			render_system();
+			engine.clear();
+			engine.begin_frame(screen_proj.projection);
+			try {
+				if (programs_ready()) {
+					render_system();
+				}
+			} catch (const std::exception& e) {
+				std::println("{}", e.what());
+				return SDL_AppResult::SDL_APP_FAILURE;
+			}
 
 			engine.render(window);
 
-			previous_time = t;
+			if (options.frame_count != 0 and ++frame == options.frame_count) {
+				const auto elapsed = std::chrono::steady_clock::now() - start_time;
+				std::println("{} frames in {:.3f} s", frame, std::chrono::duration<double>(elapsed).count());
+				return SDL_AppResult::SDL_APP_SUCCESS;
+			}
 
 			return SDL_AppResult::SDL_APP_CONTINUE;
 		}
 
 	private:
-		explicit App(SDL_Window* window, vis::engine::Engine& engine)
-				: window{window}, engine(engine), program{std::nullopt} {
+		explicit App(SDL_Window* window, vis::engine::Engine& engine, const Options& options)
+				: window{window}, engine(engine), options{options}, program{std::nullopt} {
 			initialize_video();
 			initialize_physics();
 			initialize_scene();
+
+			add_random_balls(options.ball_count);
 		}
 
 		void initialize_video() {
@@ -121,74 +257,266 @@ export {
 			engine.set_viewport(0, 0, screen_width, screen_height);
 			screen_proj = vis::orthogonal_matrix(screen_width, screen_height, 20.0f, 20.0f);
 
-			// TODO: load this from file or even better, build using SPRIV during compilation time
-			program = vis::opengl::ProgramBuilder{}
-										.add_shader(vis::opengl::Shader::create(vis::opengl::ShaderType::vertex, R"(
-#version 410 core
-layout (location = 0) in vec2 pos;
-layout (location = 1) in vec4 col;
+			// built in the background, the frames are only cleared until they are ready
+			program_build_begin = std::chrono::steady_clock::now();
+			pending_program = build_program(vis::shaders::instanced_vertex);
+			pending_batch_program = build_program(vis::shaders::mesh_vertex);
+			pending_circle_program = build_program(vis::shaders::instanced_circle_vertex, vis::shaders::circle_fragment);
+			circle_mesh = &mesh_library.circle();
+			std::println("Multi draw indirect: {}", multi_draw.uses_multi_draw_indirect() ? "yes" : "no, one draw per mesh");
+		}
 
-uniform mat4 model_view_projection;
+		std::shared_ptr<vis::opengl::PendingProgram>
+		build_program(std::string_view vertex_source, std::string_view fragment_source = vis::shaders::color_fragment) {
+			auto builder = vis::opengl::ProgramBuilder{};
+			builder.add_shader(vis::opengl::ShaderType::vertex, vertex_source)
+					.add_shader(vis::opengl::ShaderType::fragment, fragment_source);
+			if (not options.shader_cache.empty()) {
+				builder.with_binary_cache(options.shader_cache);
+			}
 
-out vec4 vertex_color;
+			return engine.build_async(builder);
+		}
 
-void main()
-{
-    gl_Position = model_view_projection * vec4(pos.xy, 0.0f, 1.0f);
-		vertex_color = col;
-}
-)"))
-										.add_shader(vis::opengl::Shader::create(vis::opengl::ShaderType::fragment, R"(
-#version 410 core
+		// Takes the programs once the engine has built them. A cold start compiles and fills the binary cache, a warm
+		// start loads the binaries
+		[[nodiscard]] bool programs_ready() {
+			if (program) {
+				return true;
+			}
 
-in vec4 vertex_color;
-out vec4 fragment_color;
+			const auto pending = std::array{pending_program.get(), pending_batch_program.get(), pending_circle_program.get()};
+			if (not std::ranges::all_of(pending, &vis::opengl::PendingProgram::is_ready)) {
+				return false;
+			}
 
-void main()
-{
-//    FragColor = vec4(0.0f, 0.5f, 0.2f, 1.0f);
-		fragment_color = vertex_color;
-}
-)"))
-										.build();
+			const auto cached_programs = std::ranges::count_if(pending, &vis::opengl::PendingProgram::loaded_from_cache);
+			program = pending_program->take();
+			batch_program = pending_batch_program->take();
+			circle_program = pending_circle_program->take();
+			pending_program.reset();
+			pending_batch_program.reset();
+			pending_circle_program.reset();
 
-			if (not program) {
-				throw std::runtime_error{"Unable to initialize the video"};
+			if (not program or not batch_program or not circle_program) {
+				throw std::runtime_error{"Unable to build the shader programs"};
 			}
+
+			std::println("Programs ready in {:.3f} ms, {} of {} from the binary cache ({} start)",
+									 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - program_build_begin)
+											 .count(),
+									 cached_programs, pending.size(), cached_programs == std::ssize(pending) ? "warm" : "cold");
+
+			batch_model_view_projection_uniform = batch_program->uniform<vis::mat4>("model_view_projection");
+			view_projection_uniform = program->uniform<vis::mat4>("view_projection");
+			circle_view_projection_uniform = circle_program->uniform<vis::mat4>("view_projection");
+			return true;
 		}
 
 		void render_system() {
-			const auto view = entity_registry.view<vis::mesh::Mesh, vis::physics::Transformation>();
+			const auto scope = vis::profile::Scope{"render_system"};
+			switch (render_mode) {
+			case RenderMode::instanced:
+				render_instanced();
+				break;
+			case RenderMode::batched:
+				render_batched();
+				break;
+			case RenderMode::multi_draw:
+				render_multi_draw();
+				break;
+			}
+		}
+
+		// The batcher draws plain triangles, the circles go back to polygons
+		void render_batched() {
+			shape_batcher.begin_frame();
+			const auto& circle_polygon = mesh_library.regular_shape(batched_circle_segments);
+
+			for_each_visible([&](const auto& shape, const auto& transformation, const auto& color) {
+				shape_batcher.submit(shape.mesh == circle_mesh ? circle_polygon : *shape.mesh, transformation, color.value);
+			});
+
+			batch_program->use();
+			batch_program->set(batch_model_view_projection_uniform, screen_proj.projection);
+			shape_batcher.flush(*batch_program);
+		}
+
+		// The engine sorts the queue and draws every unique mesh once, when the frame is rendered
+		void render_instanced() {
+			auto& render_queue = engine.render_queue();
+
+			for_each_visible([&](const auto& shape, const auto& transformation, const auto& color) {
+				render_queue.submit(scene_layer, program_for(*shape.mesh), view_projection_for(*shape.mesh), *shape.mesh,
+														to_instance(transformation, color));
+			});
+		}
+
+		// One indirect draw for the polygons and one for the circles
+		void render_multi_draw() {
+			multi_draw.begin_frame();
+			circle_multi_draw.begin_frame();
+
+			for_each_visible([&](const auto& shape, const auto& transformation, const auto& color) {
+				auto& renderer = shape.mesh == circle_mesh ? circle_multi_draw : multi_draw;
+				renderer.submit(*shape.mesh, to_instance(transformation, color));
+			});
+
 			program->use();
+			program->set(view_projection_uniform, screen_proj.projection);
+			multi_draw.execute(*program);
+
+			circle_program->use();
+			circle_program->set(circle_view_projection_uniform, screen_proj.projection);
+			circle_multi_draw.execute(*circle_program);
+		}
+
+		[[nodiscard]] vis::physics::AABB camera() const {
+			return vis::physics::AABB{-screen_proj.half_world_extent, screen_proj.half_world_extent};
+		}
+
+		// Calls fn(mesh_ref, transformation, color) for the shapes inside the camera. The physics bodies come from the
+		// broadphase query of the last snapshot, the shapes without a body are tested one by one against the bounding
+		// circle of their mesh. The sleeping bodies are not skipped: every render mode rebuilds and uploads its instance
+		// data each frame, keeping the resting ones in a persistent part of the instance buffer is not done
+		template <typename Fn> void for_each_visible(Fn&& fn) {
+			const auto scope = vis::profile::Scope{"for_each_visible"};
+			const auto camera = this->camera();
+			const auto shapes =
+					entity_registry.view<vis::mesh::MeshRef, vis::physics::Transformation, vis::mesh::Color>();
+			visible_count = 0;
+
+			for (const auto entity : snapshot->visible) {
+				if (shapes.contains(entity)) {
+					std::apply(fn, shapes.get(entity));
+					++visible_count;
+				}
+			}
 
-			view.each([&](const auto& shape, const auto& transformation) {
-				const vis::mat4 model_view = transformation.get_model();
-				const auto model_view_projection = screen_proj.projection * model_view;
-				program->set_uniform("model_view_projection", model_view_projection);
-				shape.draw(*program);
-				shape.unbind();
+			const auto free_shapes =
+					entity_registry.view<vis::mesh::MeshRef, vis::physics::Transformation, vis::mesh::Color>(
+							vis::ecs::exclude<vis::physics::RigidBody>);
+			free_shapes.each([&](const auto& shape, const auto& transformation, const auto& color) {
+				const auto extent = shape.mesh->bounding_radius() * std::max(transformation.scale.x, transformation.scale.y);
+				const auto& position = transformation.position;
+				if (position.x + extent >= camera.lower.x and position.x - extent <= camera.upper.x and
+						position.y + extent >= camera.lower.y and position.y - extent <= camera.upper.y) {
+					fn(shape, transformation, color);
+					++visible_count;
+				}
 			});
 		}
 
-		void update_physic_system(float t, float dt) {
-			static float accumulated_time = 0.0f;
-			static constexpr float fixed_time_step = 1 / 30.0f;
+		[[nodiscard]] const vis::opengl::Program& program_for(const vis::mesh::Mesh& mesh) const {
+			return &mesh == circle_mesh ? *circle_program : *program;
+		}
+
+		[[nodiscard]] vis::opengl::UniformHandle<vis::mat4> view_projection_for(const vis::mesh::Mesh& mesh) const {
+			return &mesh == circle_mesh ? circle_view_projection_uniform : view_projection_uniform;
+		}
 
-			accumulated_time += dt;
+		static vis::mesh::InstanceData to_instance(const vis::physics::Transformation& transformation,
+																							 const vis::mesh::Color& color) {
+			const auto& [position, scale, rotation] = transformation;
+			return vis::mesh::InstanceData{
+					.transform = vis::vec4{position, rotation.cos_angle, rotation.sin_angle},
+					.scale = scale,
+					.color = color.value,
+			};
+		}
 
-			while (accumulated_time >= fixed_time_step) {
-				world->step(fixed_time_step, 4);
-				accumulated_time -= fixed_time_step;
+		// Takes the latest snapshot of the simulation thread, never waits for a step in progress
+		void sync_simulation() {
+			const auto scope = vis::profile::Scope{"sync_simulation"};
+			snapshot = &simulation->latest();
+			if (snapshot->step != synced_step) {
+				const auto previous_step = std::exchange(synced_step, snapshot->step);
+				sync_bodies(snapshot->bodies);
+				paint_hits(snapshot->hits, previous_step);
 			}
 
-			const auto view = entity_registry.view<vis::physics::Transformation, vis::physics::RigidBody>();
-			view.each([&](auto& tr, const auto& body) { tr = body.get_transform(); });
+			interpolate_transformations(simulation->alpha(*snapshot));
+		}
+
+		// The snapshot has the awake bodies and those that fell asleep since the last one, syncing a resting pile costs
+		// nothing. The Awake tag follows the bodies, the despawned entities still in the snapshot are skipped
+		void sync_bodies(std::span<const vis::physics::BodyState> bodies) {
+			for (const auto& body : bodies) {
+				if (not entity_registry.valid(body.entity)) {
+					continue;
+				}
+
+				const auto was_awake = entity_registry.all_of<vis::physics::Awake>(body.entity);
+				if (body.awake and not was_awake) {
+					entity_registry.emplace<vis::physics::Awake>(body.entity);
+				} else if (not body.awake and was_awake) {
+					entity_registry.remove<vis::physics::Awake>(body.entity);
+				}
+
+				if (auto* interpolated = entity_registry.try_get<vis::physics::InterpolatedTransformation>(body.entity)) {
+					interpolated->previous.position = body.previous_position;
+					interpolated->previous.rotation = body.previous_rotation;
+					interpolated->current.position = body.position;
+					interpolated->current.rotation = body.rotation;
+					// left out of the interpolation from now on, it must rest where it stopped
+					if (not body.awake) {
+						interpolated->previous = interpolated->current;
+						entity_registry.replace<vis::physics::Transformation>(body.entity, interpolated->current);
+					}
+				} else if (auto* transformation = entity_registry.try_get<vis::physics::Transformation>(body.entity)) {
+					transformation->position = body.position;
+					transformation->rotation = body.rotation;
+				}
+			}
+		}
+
+		// A ball hit harder than the hit threshold of the world turns from yellow to red with the speed. The hits up to
+		// previous_step were already handled with an earlier snapshot
+		void paint_hits(std::span<const vis::physics::ContactHit> hits, std::uint64_t previous_step) {
+			for (const auto& hit : hits) {
+				if (hit.step <= previous_step) {
+					continue;
+				}
+
+				const auto heat = std::clamp(hit.approach_speed / hot_hit_speed, 0.0f, 1.0f);
+				for (const auto entity : {hit.entity_a, hit.entity_b}) {
+					if (entity_registry.valid(entity) and entity_registry.all_of<Ball>(entity)) {
+						entity_registry.replace<vis::mesh::Color>(entity, vis::vec4{1.0f, 1.0f - heat, 0.0f, 1.0f});
+					}
+				}
+			}
+		}
+
+		// The sleeping bodies don't move, only the awake ones are interpolated
+		void interpolate_transformations(float alpha) {
+			const auto view =
+					entity_registry.view<vis::physics::Transformation, const vis::physics::InterpolatedTransformation,
+															 const vis::physics::Awake>();
+			view.each([&](auto& transformation, const auto& interpolated) {
+				transformation = vis::physics::interpolate(interpolated.previous, interpolated.current, alpha);
+			});
 		}
 
 		void initialize_physics() {
+			const auto workers = options.workers == 0 ? std::max(1u, std::thread::hardware_concurrency())
+																								: static_cast<std::uint32_t>(options.workers);
+			tasks.emplace(std::min(workers, vis::physics::max_workers));
+			std::println("Physics workers: {}", tasks->worker_count());
+
 			auto world_def = vis::physics::WorldDef();
 			world_def.set_gravity(vis::vec2{0.0f, 0.0f * -9.81f});
-			world = vis::physics::create_world(world_def);
+			world_def.set_task_system(*tasks);
+			world_def.set_enable_sleep(options.sleep);
+			simulation.emplace(std::move(*vis::physics::create_world(world_def)),
+												 1.0f / static_cast<float>(options.physics_rate), 4, camera(), ball_pool_capacity);
+			snapshot = &simulation->latest();
+
+			// any entity destroyed with a body, the world is on the simulation thread
+			entity_registry.on_destroy<vis::physics::RigidBody>().connect<&App::release_body>(*this);
+		}
+
+		void release_body(vis::ecs::registry& registry, vis::ecs::entity entity) {
+			simulation->destroy_body(std::move(registry.get<vis::physics::RigidBody>(entity)));
 		}
 
 		void initialize_scene() {
@@ -216,83 +544,213 @@ void main()
 		}
 
 		void add_wall(vis::vec2 half_extent, vis::vec2 pos, vis::vec4 color) {
-			constexpr auto origin = vis::vec2{0.0f, 0.0f};
 			auto wall = entity_registry.create();
-			entity_registry.emplace<vis::mesh::Mesh>(wall, vis::mesh::create_rectangle_shape(origin, half_extent, color));
+			entity_registry.emplace<vis::mesh::MeshRef>(wall, &mesh_library.rectangle());
+			entity_registry.emplace<vis::mesh::Color>(wall, color);
 			auto& transform = entity_registry.emplace<vis::physics::Transformation>(wall, vis::physics::Transformation{
 																																												.position = pos,
+																																												.scale = half_extent,
 																																										});
 			vis::physics::RigidBodyDef body_def;
-			body_def.set_position(transform.position).set_body_type(vis::physics::BodyType::fixed);
-			auto& rigid_body = entity_registry.emplace<vis::physics::RigidBody>(wall, world->create_body(body_def));
-
-			auto wall_box = vis::physics::create_box2d(half_extent);
-			vis::physics::ShapeDef wall_shape;
-			rigid_body.create_shape(wall_shape, wall_box);
+			body_def.set_position(transform.position).set_body_type(vis::physics::BodyType::fixed).set_entity(wall);
+			add_body(wall, body_def, vis::physics::ShapeDef{}, vis::physics::create_box2d(half_extent));
 		}
 
 		void add_box(vis::vec2 half_extent, vis::vec2 pos, vis::vec4 color) {
-			constexpr auto origin = vis::vec2{0.0f, 0.0f};
 			auto wall = entity_registry.create();
-			entity_registry.emplace<vis::mesh::Mesh>(wall, vis::mesh::create_rectangle_shape(origin, half_extent, color));
+			entity_registry.emplace<vis::mesh::MeshRef>(wall, &mesh_library.rectangle());
+			entity_registry.emplace<vis::mesh::Color>(wall, color);
 			const auto angle = vis::radians(45.0f);
 			vis::physics::Rotation rot{.cos_angle = std::cos(angle), .sin_angle = std::sin(angle)};
 			auto& transform = entity_registry.emplace<vis::physics::Transformation>(wall, vis::physics::Transformation{
 																																												.position = pos,
+																																												.scale = half_extent,
 																																												.rotation = rot,
 																																										});
 			vis::physics::RigidBodyDef body_def;
-			body_def.set_position(transform.position).set_body_type(vis::physics::BodyType::fixed).set_rotation(rot);
-			auto& rigid_body = entity_registry.emplace<vis::physics::RigidBody>(wall, world->create_body(body_def));
+			body_def.set_position(transform.position)
+					.set_body_type(vis::physics::BodyType::fixed)
+					.set_rotation(rot)
+					.set_entity(wall);
+			add_body(wall, body_def, vis::physics::ShapeDef{}, vis::physics::create_box2d(half_extent));
+		}
 
-			auto wall_box = vis::physics::create_box2d(half_extent);
-			vis::physics::ShapeDef wall_shape;
-			rigid_body.create_shape(wall_shape, wall_box);
+		void add_random_ball() {
+			const auto ball = random_ball(vis::vec2{-10.0f, 8.0f}, vis::vec2{10.0f, 8.0f}, 0.5f, 2.0f);
+			add_balls(std::span{&ball, 1});
 		}
 
-		void add_ball(float radius, vis::vec2 pos, vis::vec2 vel, vis::vec4 color) {
-			constexpr auto origin = vis::vec2{0.0f, 0.0f};
-			auto ball = entity_registry.create();
+		// Small slow balls spread over the whole screen, a crowd rather than a few fast bouncing ones
+		void add_random_balls(int count) {
+			const auto camera = this->camera();
+			spawn_balls.clear();
+			for (int i = 0; i != count; ++i) {
+				auto ball = random_ball(camera.lower + mass_spawn_margin, camera.upper - mass_spawn_margin, 0.05f, 0.15f);
+				ball.velocity *= 0.1f;
+				ball.is_bullet = false;
+				spawn_balls.push_back(ball);
+			}
+			add_balls(spawn_balls);
+		}
 
-			entity_registry.emplace<Ball>(ball);
-			entity_registry.emplace<vis::mesh::Mesh>(ball, vis::mesh::create_regular_shape(origin, radius, color, 20));
+		static BallSpawn random_ball(vis::vec2 lower, vis::vec2 upper, float min_radius, float max_radius) {
+			auto get_random = [](float min = 0.0f, float max = 1.0f) -> float {
+				auto r = static_cast<float>(std::rand()) / static_cast<float>(RAND_MAX);
+				return (max - min) * r + min;
+			};
 
-			auto& transform = entity_registry.emplace<vis::physics::Transformation>(ball, vis::physics::Transformation{
-																																												.position = pos,
-																																										});
-			auto circle = vis::physics::Circle{
-					.center = origin,
-					.radius = radius,
+			return BallSpawn{
+					.radius = get_random(min_radius, max_radius),
+					.position = vis::vec2{get_random(lower.x, upper.x), get_random(lower.y, upper.y)},
+					.velocity = vis::vec2{get_random(-10.0f, 10.0f), get_random(-10.0f, 10.0f)},
+					.color = vis::vec4{get_random(), get_random(), get_random(), 1.0f},
 			};
+		}
 
-			vis::physics::RigidBodyDef body_def;
-			body_def.set_position(transform.position)
-					.set_body_type(vis::physics::BodyType::dynamic)
-					.set_is_bullet(true)
-					.set_linear_velocity(vel);
+		// Spawns the balls in one go: every storage grows once, the components are inserted by range and all the bodies
+		// are created during a single wait on the simulation thread
+		void add_balls(std::span<const BallSpawn> balls) {
+			const auto scope = vis::profile::Scope{"add_balls"};
+			if (balls.empty()) {
+				return;
+			}
 
-			auto& rigid_body = entity_registry.emplace<vis::physics::RigidBody>(ball, vis::physics::RigidBody{
-																																										world->create_body(body_def),
-																																								});
+			reserve<vis::ecs::entity, Ball, vis::physics::Awake, vis::mesh::MeshRef, vis::mesh::Color,
+							vis::physics::Transformation, vis::physics::InterpolatedTransformation, vis::physics::RigidBody>(
+					balls.size());
+
+			spawned.resize(balls.size());
+			entity_registry.create(spawned.begin(), spawned.end());
+
+			const auto transformations = balls | std::views::transform([](const BallSpawn& ball) {
+																		 return vis::physics::Transformation{
+																				 .position = ball.position,
+																				 .scale = vis::vec2{ball.radius, ball.radius},
+																				 .rotation = {1.0f, 0.0f},
+																		 };
+																	 });
+			const auto interpolated = transformations | std::views::transform([](const auto& transformation) {
+																	return vis::physics::InterpolatedTransformation{transformation, transformation};
+																});
+			const auto colors =
+					balls | std::views::transform([](const BallSpawn& ball) { return vis::mesh::Color{ball.color}; });
+
+			entity_registry.insert<Ball>(spawned.begin(), spawned.end());
+			entity_registry.insert<vis::physics::Awake>(spawned.begin(), spawned.end());
+			entity_registry.insert<vis::mesh::MeshRef>(spawned.begin(), spawned.end(), vis::mesh::MeshRef{circle_mesh});
+			entity_registry.insert<vis::mesh::Color>(spawned.begin(), spawned.end(), colors.begin());
+			entity_registry.insert<vis::physics::Transformation>(spawned.begin(), spawned.end(), transformations.begin());
+			entity_registry.insert<vis::physics::InterpolatedTransformation>(spawned.begin(), spawned.end(),
+																																			 interpolated.begin());
+
+			body_defs.clear();
+			for (const auto& [entity, ball] : std::views::zip(spawned, balls)) {
+				auto& body_def = body_defs.emplace_back();
+				body_def.set_position(ball.position)
+						.set_body_type(vis::physics::BodyType::dynamic)
+						.set_is_bullet(ball.is_bullet)
+						.set_linear_velocity(ball.velocity)
+						.set_entity(entity);
+			}
 
 			vis::physics::ShapeDef shape_def;
-			shape_def.set_restitution(1.0).set_friction(1.0f);
-			rigid_body.create_shape(shape_def, circle);
+			shape_def.set_restitution(1.0).set_friction(1.0f).set_enable_hit_events(true);
+			simulation->create_bodies(body_defs, spawned_bodies, [&](auto& body, std::size_t i, bool recycled) {
+				const auto circle = vis::physics::Circle{.radius = balls[i].radius};
+				if (recycled) {
+					body.set_circle(circle);
+				} else {
+					body.create_shape(shape_def, circle);
+				}
+			});
+			entity_registry.insert<vis::physics::RigidBody>(spawned.begin(), spawned.end(),
+																											std::make_move_iterator(spawned_bodies.begin()));
+		}
+
+		// The bodies go back to the pool of the simulation thread, the next spawns take them again
+		void despawn_balls(std::size_t count) {
+			const auto scope = vis::profile::Scope{"despawn_balls"};
+			const auto balls = entity_registry.view<Ball, vis::physics::RigidBody>();
+			despawned.clear();
+			recycled_bodies.clear();
+			for (const auto entity : balls) {
+				if (despawned.size() == count) {
+					break;
+				}
+				despawned.push_back(entity);
+				recycled_bodies.push_back(std::move(balls.get<vis::physics::RigidBody>(entity)));
+			}
+
+			simulation->recycle_bodies(recycled_bodies);
+			entity_registry.destroy(despawned.begin(), despawned.end());
+		}
+
+		// Grows every storage once for `count` more entities
+		template <typename... Components> void reserve(std::size_t count) {
+			(entity_registry.storage<Components>().reserve(entity_registry.storage<Components>().size() + count), ...);
+		}
+
+		// The world belongs to the simulation thread, the bodies are created in between two steps
+		template <typename Shape>
+		void add_body(vis::ecs::entity entity, const vis::physics::RigidBodyDef& body_def,
+									const vis::physics::ShapeDef& shape_def, const Shape& shape) {
+			simulation->with_world([&](const vis::physics::World& world) {
+				entity_registry.emplace<vis::physics::RigidBody>(entity, world.create_body(body_def))
+						.create_shape(shape_def, shape);
+			});
 		}
 
 	private:
 		SDL_Window* window = nullptr;
 		vis::engine::Engine& engine;
+		Options options;
+		int frame = 0;
+		std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
 
 		int screen_width = SCREEN_WIDTH;
 		int screen_height = SCREEN_HEIGHT;
 		static constexpr SDL_WindowFlags screen_flags = SDL_WINDOW_OPENGL;
-
+		static constexpr std::uint8_t scene_layer = 0;
+		static constexpr std::size_t trace_frames = 300;
+		static constexpr int batched_circle_segments = 20;
+		static constexpr int mass_spawn_count = 10'000;
+		static constexpr auto mass_spawn_margin = vis::vec2{1.0f, 1.0f};
+		static constexpr std::size_t ball_pool_capacity = 20'000;
+		static constexpr float hot_hit_speed = 20.0f; // m/s, paints a ball full red
+		static constexpr auto render_mode_count = std::to_underlying(RenderMode::multi_draw) + 1;
+
+		std::shared_ptr<vis::opengl::PendingProgram> pending_program;
+		std::shared_ptr<vis::opengl::PendingProgram> pending_batch_program;
+		std::shared_ptr<vis::opengl::PendingProgram> pending_circle_program;
+		std::chrono::steady_clock::time_point program_build_begin{};
 		std::optional<vis::opengl::Program> program{};
+		std::optional<vis::opengl::Program> batch_program{};
+		std::optional<vis::opengl::Program> circle_program{};
+		vis::opengl::UniformHandle<vis::mat4> batch_model_view_projection_uniform;
+		vis::opengl::UniformHandle<vis::mat4> view_projection_uniform;
+		vis::opengl::UniformHandle<vis::mat4> circle_view_projection_uniform;
+		RenderMode render_mode = RenderMode::instanced;
+		vis::batch::ShapeBatcher shape_batcher;
+		vis::render::MultiDrawRenderer multi_draw;
+		vis::render::MultiDrawRenderer circle_multi_draw;
+		vis::mesh::MeshLibrary mesh_library;
+		const vis::mesh::Mesh* circle_mesh = nullptr;
 		vis::ecs::registry entity_registry;
 		vis::ScreenProjection screen_proj;
 
-		std::optional<vis::physics::World> world;
+		std::optional<vis::tasks::TaskSystem> tasks; // before the simulation, its world uses it until destroyed
+		std::optional<vis::physics::SimulationThread> simulation;
+		const vis::physics::WorldSnapshot* snapshot = nullptr; // taken at the beginning of the frame
+		std::uint64_t synced_step = 0;
+
+		// reused by every spawn
+		std::vector<BallSpawn> spawn_balls;
+		std::vector<vis::ecs::entity> spawned;
+		std::vector<vis::physics::RigidBodyDef> body_defs;
+		std::vector<vis::ecs::entity> despawned;
+		std::vector<vis::physics::RigidBody> spawned_bodies; // moved from once inserted, emptied by the next spawn
+		std::vector<vis::physics::RigidBody> recycled_bodies;
+		std::size_t visible_count = 0;
 	};
 
 	} // namespace Game
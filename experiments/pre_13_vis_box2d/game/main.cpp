@@ -1,11 +1,12 @@
 #include <SDL3/SDL_main.h>
 
+import std;
 import Game;
 
 extern "C" {
 
 SDL_AppResult SDL_AppInit(void** appstate, int argc, char** argv) {
-	*appstate = Game::App::create();
+	*appstate = Game::App::create(std::span<char*>{argv, static_cast<std::size_t>(argc)});
 
 	if (*appstate == nullptr) {
 		return SDL_AppResult::SDL_APP_FAILURE;
@@ -0,0 +1,185 @@
+module;
+
+#include <GL/glew.h>
+
+#include <cassert>
+
+export module vis:batch;
+
+import std;
+import :math;
+import :opengl;
+import :mesh;
+import :physic;
+
+#ifdef NDEBUG
+#define CHECK_LAST_GL_CALL
+#else
+#define CHECK_LAST_GL_CALL                                                                                             \
+	do {                                                                                                                 \
+		auto err = glGetError();                                                                                           \
+		if (err) {                                                                                                         \
+			std::println("[{}][{}:{}] An OpenGL Error occurred", __FILE__, __func__, __LINE__);                              \
+			assert(err == 0);                                                                                                \
+		}                                                                                                                  \
+	} while (false)
+#endif
+
+export namespace vis::batch {
+
+struct FrameStats {
+	std::size_t shapes{};
+	std::size_t vertices{};
+	std::size_t bytes{};
+	std::size_t draw_calls{};
+};
+
+// Merges many small, different meshes into a few draws. Every submitted mesh is transformed on the CPU into world
+// space and appended to a list of its primitive type (indices resolved, fans and strips unrolled), then flush streams
+// each list into one buffer and issues a single glDrawArrays per primitive type.
+// The program used for the flush must take world space positions, e.g. vis::shaders::mesh_vertex with the
+// projection as model_view_projection.
+class ShapeBatcher {
+public:
+	ShapeBatcher() : vbo{GL_ARRAY_BUFFER} {
+		vao.bind();
+		vbo.bind();
+
+		for (const auto& attribute : vis::mesh::VertexLayout<vis::mesh::Vertex>::attributes) {
+			vis::mesh::enable_vertex_attribute(attribute);
+		}
+
+		vbo.unbind();
+		vao.unbind();
+	}
+
+	ShapeBatcher(const ShapeBatcher&) = delete;
+	ShapeBatcher& operator=(const ShapeBatcher&) = delete;
+
+	void begin_frame() {
+		frame_stats = {};
+	}
+
+	void submit(const vis::mesh::Mesh& mesh, const vis::physics::Transformation& transformation,
+							const vis::vec4& color = vis::vec4{1.0f}) {
+		const auto& draw = mesh.draw_description();
+		const auto vertices = mesh.vertices();
+		const auto indices = mesh.indices();
+		const auto count = static_cast<std::size_t>(draw.vertex_count);
+
+		// i-th vertex of the draw, through the indices for an indexed mesh
+		const auto at = [&](std::size_t i) {
+			const auto& [position, scale, rotation] = transformation;
+			const auto n = static_cast<std::size_t>(draw.first) + i;
+			const auto& v = indices.empty() ? vertices[n] : vertices[indices[n] + draw.base_vertex];
+			const auto scaled = v.pos * scale;
+			return vis::mesh::Vertex{
+					.pos = vis::vec2{rotation.cos_angle * scaled.x - rotation.sin_angle * scaled.y,
+													 rotation.sin_angle * scaled.x + rotation.cos_angle * scaled.y} +
+								 position,
+					.color = v.color * color,
+			};
+		};
+
+		switch (draw.mode) {
+		case GL_TRIANGLES:
+			append(triangles, count, at);
+			break;
+		case GL_TRIANGLE_FAN:
+			for (std::size_t i = 2; i < count; ++i) {
+				triangles.push_back(at(0));
+				triangles.push_back(at(i - 1));
+				triangles.push_back(at(i));
+			}
+			break;
+		case GL_TRIANGLE_STRIP:
+			for (std::size_t i = 2; i < count; ++i) {
+				// keep the winding consistent on the odd triangles
+				const bool odd = (i % 2) != 0;
+				triangles.push_back(at(odd ? i - 1 : i - 2));
+				triangles.push_back(at(odd ? i - 2 : i - 1));
+				triangles.push_back(at(i));
+			}
+			break;
+		case GL_LINES:
+			append(lines, count, at);
+			break;
+		case GL_LINE_STRIP:
+		case GL_LINE_LOOP:
+			for (std::size_t i = 1; i < count; ++i) {
+				lines.push_back(at(i - 1));
+				lines.push_back(at(i));
+			}
+			if (draw.mode == GL_LINE_LOOP and count > 2) {
+				lines.push_back(at(count - 1));
+				lines.push_back(at(0));
+			}
+			break;
+		case GL_POINTS:
+			append(points, count, at);
+			break;
+		default:
+			throw std::runtime_error{std::format("Primitive mode {:#x} can't be batched", draw.mode)};
+		}
+
+		++frame_stats.shapes;
+	}
+
+	// Streams and draws everything submitted since the last flush, the caller sets the uniforms of `program`
+	void flush(const vis::opengl::Program& program) {
+		vao.bind();
+		vbo.bind();
+
+		program.use();
+		stream(GL_TRIANGLES, triangles);
+		stream(GL_LINES, lines);
+		stream(GL_POINTS, points);
+	}
+
+	[[nodiscard]] const FrameStats& stats() const {
+		return frame_stats;
+	}
+
+private:
+	template <typename VertexAt>
+	static void append(std::vector<vis::mesh::Vertex>& out, std::size_t count, VertexAt&& at) {
+		for (std::size_t i = 0; i != count; ++i) {
+			out.push_back(at(i));
+		}
+	}
+
+	void stream(GLenum mode, std::vector<vis::mesh::Vertex>& vertices) {
+		if (vertices.empty()) {
+			return;
+		}
+
+		const auto size_in_bytes = vertices.size() * sizeof(vis::mesh::Vertex);
+		capacity = std::max(capacity, std::bit_ceil(size_in_bytes));
+
+		// orphan the storage, the previous flush may still be reading it
+		vbo.data(capacity, nullptr, GL_STREAM_DRAW);
+		vbo.sub_data(0, size_in_bytes, vertices.data());
+
+		glDrawArrays(mode, 0, static_cast<GLsizei>(vertices.size()));
+		CHECK_LAST_GL_CALL;
+
+		frame_stats.vertices += vertices.size();
+		frame_stats.bytes += size_in_bytes;
+		++frame_stats.draw_calls;
+
+		vertices.clear();
+	}
+
+private:
+	vis::opengl::VertexArrayObject vao;
+	vis::opengl::VertexBufferObject vbo;
+	std::size_t capacity{};
+
+	std::vector<vis::mesh::Vertex> triangles;
+	std::vector<vis::mesh::Vertex> lines;
+	std::vector<vis::mesh::Vertex> points;
+
+	FrameStats frame_stats;
+};
+
+} // namespace vis::batch
@@ -1,5 +1,7 @@
 module;
 
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
 #include <SDL3/SDL.h>
 
 export module vis:engine;
@@ -8,38 +10,304 @@ import std;
 
 import :math;
 import :opengl;
+import :profile;
+import :render;
+
+namespace vis::engine {
+
+// OpenGL context that needs neither a display server nor a window: EGL on the surfaceless platform (Mesa llvmpipe
+// works) and the frames rendered in an offscreen framebuffer.
+class OffscreenContext {
+public:
+	OffscreenContext(int width, int height, bool read_back) : read_back{read_back} {
+		const std::string_view client_extensions = query_string(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (client_extensions.contains("EGL_MESA_platform_surfaceless")) {
+			display = eglGetPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		}
+		if (display == EGL_NO_DISPLAY) {
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		}
+
+		if (display == EGL_NO_DISPLAY or not eglInitialize(display, nullptr, nullptr)) {
+			throw std::runtime_error{std::format("Unable to initialize EGL: {:#x}", eglGetError())};
+		}
+
+		if (not eglBindAPI(EGL_OPENGL_API)) {
+			eglTerminate(display);
+			throw std::runtime_error{"EGL doesn't support desktop OpenGL"};
+		}
+
+		constexpr EGLint config_attributes[] = {
+				EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE,
+		};
+		EGLConfig config = nullptr;
+		EGLint config_count = 0;
+		if (not eglChooseConfig(display, config_attributes, &config, 1, &config_count) or config_count == 0) {
+			eglTerminate(display);
+			throw std::runtime_error{"No EGL config for desktop OpenGL"};
+		}
+
+		constexpr EGLint context_attributes[] = {
+				EGL_CONTEXT_MAJOR_VERSION,
+				4,
+				EGL_CONTEXT_MINOR_VERSION,
+				1,
+				EGL_CONTEXT_OPENGL_PROFILE_MASK,
+				EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#ifndef NDEBUG
+				EGL_CONTEXT_OPENGL_DEBUG,
+				EGL_TRUE,
+#endif
+				EGL_NONE,
+		};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+		if (context == EGL_NO_CONTEXT) {
+			eglTerminate(display);
+			throw std::runtime_error{std::format("Unable to create the EGL context: {:#x}", eglGetError())};
+		}
+
+		// The framebuffer is the real target, a 1x1 pbuffer is only needed when a context can't be made current alone
+		if (not std::string_view{query_string(display, EGL_EXTENSIONS)}.contains("EGL_KHR_surfaceless_context")) {
+			constexpr EGLint pbuffer_attributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+			surface = eglCreatePbufferSurface(display, config, pbuffer_attributes);
+		}
+
+		if (not eglMakeCurrent(display, surface, surface, context)) {
+			release();
+			throw std::runtime_error{std::format("Unable to make the EGL context current: {:#x}", eglGetError())};
+		}
+
+		// the destructor doesn't run for a constructor that throws, the context is released here
+		try {
+			vis::opengl::renderer_init_headless();
+
+			framebuffer.emplace(width, height);
+			framebuffer->bind();
+			if (read_back) {
+				pixels.resize(framebuffer->size_in_bytes());
+			}
+		} catch (...) {
+			framebuffer.reset();
+			release();
+			throw;
+		}
+	}
+
+	~OffscreenContext() {
+		framebuffer.reset();
+		release();
+	}
+
+	OffscreenContext(const OffscreenContext&) = delete;
+	OffscreenContext& operator=(const OffscreenContext&) = delete;
+
+	void present() {
+		if (read_back) {
+			framebuffer->read_pixels(pixels);
+		}
+	}
+
+	// RGBA8, bottom row first, empty unless the read back was asked
+	[[nodiscard]] std::span<const std::uint8_t> last_frame() const {
+		return pixels;
+	}
+
+private:
+	static const char* query_string(EGLDisplay display, EGLint name) {
+		const char* value = eglQueryString(display, name);
+		return value != nullptr ? value : "";
+	}
+
+	void release() {
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (surface != EGL_NO_SURFACE) {
+			eglDestroySurface(display, surface);
+		}
+		eglDestroyContext(display, context);
+		eglTerminate(display);
+	}
+
+private:
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+	EGLSurface surface = EGL_NO_SURFACE;
+	std::optional<vis::opengl::Framebuffer> framebuffer;
+	std::vector<std::uint8_t> pixels;
+	bool read_back;
+};
+
+// Mean of the last N samples
+template <std::size_t N> class RollingAverage {
+public:
+	void add(double sample) {
+		sum += sample - std::exchange(samples[next], sample);
+		next = (next + 1) % N;
+		count = std::min(count + 1, N);
+	}
+
+	[[nodiscard]] double value() const {
+		return count == 0 ? 0.0 : sum / static_cast<double>(count);
+	}
+
+private:
+	std::array<double, N> samples{};
+	std::size_t next{};
+	std::size_t count{};
+	double sum{};
+};
+
+} // namespace vis::engine
 
 export namespace vis::engine {
+
+// Milliseconds, averaged over the last frames. The GPU times come from timestamp queries, so they are a few frames
+// late. When cpu_scene_ms is the larger the scene is bound by the submission, when gpu_scene_ms is, by the GPU.
+struct FrameTimings {
+	double gpu_clear_ms{};
+	double gpu_scene_ms{};
+	double gpu_present_ms{};
+	double cpu_scene_ms{};
+};
+
+struct HeadlessOptions {
+	int width;
+	int height;
+	bool read_back = false; // keep a CPU copy of every rendered frame, costs a GPU stall per frame
+};
+
 class Engine {
 public:
 	friend Engine create(SDL_Window* window);
+	friend Engine create_headless(const HeadlessOptions& options);
 
 	static void set_clear_color(const vis::vec4& color) {
 		vis::opengl::renderer_set_clear_color(color);
 	}
 
-	static void clear() {
+	// Starts the frame
+	void clear() {
+		poll_pending_programs();
+
+		gpu_timer.mark(mark_frame_begin);
 		vis::opengl::renderer_clear();
+		gpu_timer.mark(mark_clear_end);
+		cpu_scene_begin = std::chrono::steady_clock::now();
+	}
+
+	// Starts building the program without waiting for the driver, the engine polls it at the beginning of every frame.
+	// Until the handle is ready the app can draw a loading state or a fallback program.
+	std::shared_ptr<vis::opengl::PendingProgram> build_async(vis::opengl::ProgramBuilder& builder) {
+		auto pending = builder.build_async();
+		if (not pending->is_ready()) {
+			pending_programs.push_back(pending);
+		}
+		return pending;
+	}
+
+	// Systems submit their draws here between begin_frame and render
+	vis::render::RenderQueue& render_queue() {
+		return queue;
+	}
+
+	void begin_frame(const vis::mat4& view_projection) {
+		queue.begin_frame(view_projection);
+	}
+
+	// Sorts and draws the queued commands, then presents the frame. A headless engine has no window to swap, the frame
+	// stays in the offscreen framebuffer and the loop isn't throttled by the vsync
+	void render(SDL_Window* window) {
+		const auto scope = vis::profile::Scope{"Engine::render"};
+
+		queue.execute();
+		gpu_timer.mark(mark_scene_end);
+		cpu_scene.add(
+				std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpu_scene_begin).count());
+
+		{
+			const auto present_scope = vis::profile::Scope{"Engine::present"};
+			if (offscreen) {
+				offscreen->present();
+				vis::opengl::state_cache().end_frame();
+			} else {
+				vis::opengl::renderer_render(window);
+			}
+		}
+		gpu_timer.mark(mark_present_end);
+
+		if (const auto timestamps = gpu_timer.end_frame()) {
+			const auto to_ms = [&](std::size_t from, std::size_t to) {
+				return static_cast<double>((*timestamps)[to] - (*timestamps)[from]) / 1'000'000.0;
+			};
+			gpu_clear.add(to_ms(mark_frame_begin, mark_clear_end));
+			gpu_scene.add(to_ms(mark_clear_end, mark_scene_end));
+			gpu_present.add(to_ms(mark_scene_end, mark_present_end));
+		}
+	}
+
+	[[nodiscard]] FrameTimings timings() const {
+		return FrameTimings{
+				.gpu_clear_ms = gpu_clear.value(),
+				.gpu_scene_ms = gpu_scene.value(),
+				.gpu_present_ms = gpu_present.value(),
+				.cpu_scene_ms = cpu_scene.value(),
+		};
 	}
 
-	static void render(SDL_Window* window) {
-		vis::opengl::renderer_render(window);
+	[[nodiscard]] bool is_headless() const {
+		return offscreen != nullptr;
+	}
+
+	// Last frame rendered by a headless engine created with read_back
+	[[nodiscard]] std::span<const std::uint8_t> last_frame() const {
+		return offscreen ? offscreen->last_frame() : std::span<const std::uint8_t>{};
 	}
 
 	static void set_viewport(int x, int y, int width, int height) {
 		vis::opengl::renderer_set_viewport(x, y, width, height);
 	}
 
+	// GL state changes issued and skipped by vis::opengl::state_cache() during the last rendered frame
+	static const vis::opengl::StateStats& state_stats() {
+		return vis::opengl::state_cache().frame_stats();
+	}
+
 	static void print_info() {
 		std::println("{}: ", vis::opengl::renderer_print_info());
 	}
 
 private:
+	enum Mark : std::size_t {
+		mark_frame_begin,
+		mark_clear_end,
+		mark_scene_end,
+		mark_present_end,
+		mark_count,
+	};
+
+	static constexpr std::size_t averaged_frames = 60;
+
 	explicit Engine(SDL_Window* window, SDL_GLContext context) : window{window}, opengl_context{context} {}
 
+	explicit Engine(std::unique_ptr<OffscreenContext> offscreen) : offscreen{std::move(offscreen)} {}
+
+	void poll_pending_programs() {
+		std::erase_if(pending_programs, [](const auto& pending) { return pending->poll(); });
+	}
+
 private:
 	SDL_Window* window = nullptr;
 	SDL_GLContext opengl_context = nullptr;
+	// declared before every other GL resource, so it's destroyed last
+	std::unique_ptr<OffscreenContext> offscreen;
+	vis::render::RenderQueue queue;
+	std::vector<std::shared_ptr<vis::opengl::PendingProgram>> pending_programs;
+
+	vis::opengl::TimestampQueries gpu_timer{mark_count};
+	RollingAverage<averaged_frames> gpu_clear;
+	RollingAverage<averaged_frames> gpu_scene;
+	RollingAverage<averaged_frames> gpu_present;
+	RollingAverage<averaged_frames> cpu_scene;
+	std::chrono::steady_clock::time_point cpu_scene_begin{};
 };
 
 Engine create(SDL_Window* window) {
@@ -80,4 +348,9 @@ Engine create(SDL_Window* window) {
 	return Engine(window, opengl_context);
 }
 
+Engine create_headless(const HeadlessOptions& options) {
+	auto offscreen = std::make_unique<OffscreenContext>(options.width, options.height, options.read_back);
+	return Engine(std::move(offscreen));
+}
+
 } // namespace vis::engine
\ No newline at end of file
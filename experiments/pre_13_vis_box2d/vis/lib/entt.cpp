@@ -50,6 +50,8 @@ using ::entt::continuous_loader;
 using ::entt::dispatcher;
 using ::entt::entity;
 using ::entt::entt_traits;
+using ::entt::exclude;
+using ::entt::exclude_t;
 using ::entt::flow;
 using ::entt::get;
 using ::entt::get_t;
@@ -79,6 +81,8 @@ using ::entt::snapshot_loader;
 using ::entt::sparse_set;
 using ::entt::storage;
 using ::entt::table;
+using ::entt::to_entity;
+using ::entt::to_integral;
 using ::entt::view;
 
 using ::entt::operator""_hws;
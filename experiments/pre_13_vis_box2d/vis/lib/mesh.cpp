@@ -3,6 +3,7 @@ module;
 #include <GL/glew.h>
 
 #include <cassert>
+#include <cstddef>
 
 export module vis:mesh;
 
@@ -29,46 +30,358 @@ struct Vertex {
 	vis::vec4 color;
 };
 
+// Layouts a Mesh can keep its vertexes in on the GPU. The CPU copy is always Vertex. The packed layouts quantize the
+// position, so they fit shapes around the unit size like the ones of MeshLibrary; the snorm16 ones need the positions
+// inside [-1, 1]. Without a per vertex color the attribute reads as white.
+enum class VertexFormat {
+	float32,       // vec2 position, vec4 color: 24 bytes
+	half_rgba8,    // half float position, RGBA8 color: 8 bytes
+	snorm16_rgba8, // snorm16 position, RGBA8 color: 8 bytes
+	snorm16,       // snorm16 position: 4 bytes
+};
+
+// Components of the packed vertexes, the wrapper type tells the vertex layout how the shader reads them
+struct Half {
+	std::uint16_t bits;
+};
+
+struct Snorm16 {
+	std::int16_t value;
+};
+
+struct Unorm8 {
+	std::uint8_t value;
+};
+
+struct HalfVertex {
+	std::array<Half, 2> pos;
+	std::array<Unorm8, 4> color;
+};
+
+struct Snorm16Vertex {
+	std::array<Snorm16, 2> pos;
+	std::array<Unorm8, 4> color;
+};
+
+struct Snorm16PositionVertex {
+	std::array<Snorm16, 2> pos;
+};
+
+// A normalized integer attribute (GL_SHORT, GL_UNSIGNED_BYTE with normalized set) reaches the shader as a float in
+// [-1, 1] or [0, 1]. `integer` attributes are read as ivec/uvec instead, through glVertexAttribIPointer.
 struct VertexDescription {
 	GLuint index;
 	GLint size;
 	GLenum type;
 	GLboolean normalized;
 	GLsizei stride;
-	const void* pointer;
+	std::size_t offset;
+	bool integer = false;
 };
 
+// Converts to anything, counts the members of an aggregate by how many of them it can initialize
+struct AnyMember {
+	template <typename T> constexpr operator T() const;
+};
+
+template <typename T, typename... Members> consteval std::size_t member_count() {
+	if constexpr (requires { T{Members{}..., AnyMember{}}; }) {
+		return member_count<T, Members..., AnyMember>();
+	} else {
+		return sizeof...(Members);
+	}
+}
+
+// Only used unevaluated, to get the member types of T through a structured binding
+template <typename T> auto member_types_of(T& value) {
+	constexpr auto count = member_count<T>();
+	static_assert(count >= 1 and count <= 4, "A vertex has from 1 to 4 members");
+
+	if constexpr (count == 1) {
+		auto& [a] = value;
+		return std::type_identity<std::tuple<std::remove_cvref_t<decltype(a)>>>{};
+	} else if constexpr (count == 2) {
+		auto& [a, b] = value;
+		return std::type_identity<std::tuple<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>>>{};
+	} else if constexpr (count == 3) {
+		auto& [a, b, c] = value;
+		return std::type_identity<std::tuple<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>,
+																				 std::remove_cvref_t<decltype(c)>>>{};
+	} else {
+		auto& [a, b, c, d] = value;
+		return std::type_identity<std::tuple<std::remove_cvref_t<decltype(a)>, std::remove_cvref_t<decltype(b)>,
+																				 std::remove_cvref_t<decltype(c)>, std::remove_cvref_t<decltype(d)>>>{};
+	}
+}
+
+template <typename Member>
+constexpr VertexDescription describe_member(GLuint index, GLsizei stride, std::size_t offset) {
+	const auto description = [&](GLint size, GLenum type, GLboolean normalized, bool integer = false) {
+		return VertexDescription{index, size, type, normalized, stride, offset, integer};
+	};
+
+	if constexpr (std::is_same_v<Member, float>) {
+		return description(1, GL_FLOAT, GL_FALSE);
+	} else if constexpr (std::is_same_v<Member, vis::vec2>) {
+		return description(2, GL_FLOAT, GL_FALSE);
+	} else if constexpr (std::is_same_v<Member, vis::vec4>) {
+		return description(4, GL_FLOAT, GL_FALSE);
+	} else if constexpr (requires { typename Member::value_type; std::tuple_size<Member>::value; }) {
+		using Component = typename Member::value_type;
+		constexpr auto size = static_cast<GLint>(std::tuple_size_v<Member>);
+
+		if constexpr (std::is_same_v<Component, float>) {
+			return description(size, GL_FLOAT, GL_FALSE);
+		} else if constexpr (std::is_same_v<Component, Half>) {
+			return description(size, GL_HALF_FLOAT, GL_FALSE);
+		} else if constexpr (std::is_same_v<Component, Snorm16>) {
+			return description(size, GL_SHORT, GL_TRUE);
+		} else if constexpr (std::is_same_v<Component, Unorm8>) {
+			return description(size, GL_UNSIGNED_BYTE, GL_TRUE);
+		} else if constexpr (std::is_same_v<Component, std::int32_t>) {
+			return description(size, GL_INT, GL_FALSE, true);
+		} else if constexpr (std::is_same_v<Component, std::uint32_t>) {
+			return description(size, GL_UNSIGNED_INT, GL_FALSE, true);
+		} else {
+			static_assert(sizeof(Component) == 0, "Unsupported vertex attribute component");
+		}
+	} else {
+		static_assert(sizeof(Member) == 0, "Unsupported vertex attribute");
+	}
+}
+
+constexpr std::size_t align_up(std::size_t offset, std::size_t alignment) {
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Attribute layout derived from the members of a vertex struct: the i-th member feeds attribute location i and its
+// type picks size, GL type and normalization. The offsets follow the standard layout rules, checked against sizeof.
+// The attributes are a single static array, shared by every mesh using the vertex.
+template <typename V> struct VertexLayout {
+	static_assert(std::is_aggregate_v<V> and std::is_standard_layout_v<V>);
+
+	using Members = typename decltype(member_types_of(std::declval<V&>()))::type;
+	static constexpr std::size_t count = std::tuple_size_v<Members>;
+
+	static constexpr std::array<std::size_t, count + 1> offsets = [] {
+		std::array<std::size_t, count + 1> result{};
+		std::size_t offset = 0;
+		[&]<std::size_t... I>(std::index_sequence<I...>) {
+			((result[I] = offset = align_up(offset, alignof(std::tuple_element_t<I, Members>)),
+				offset += sizeof(std::tuple_element_t<I, Members>)),
+			 ...);
+		}(std::make_index_sequence<count>{});
+		result[count] = align_up(offset, alignof(V));
+		return result;
+	}();
+	static_assert(offsets[count] == sizeof(V), "The vertex has padding the layout can't account for");
+
+	static constexpr std::array<VertexDescription, count> attributes = [] {
+		return [&]<std::size_t... I>(std::index_sequence<I...>) {
+			return std::array<VertexDescription, count>{
+					describe_member<std::tuple_element_t<I, Members>>(I, sizeof(V), offsets[I])...};
+		}(std::make_index_sequence<count>{});
+	}();
+};
+
+void enable_vertex_attribute(const VertexDescription& description) {
+	const auto pointer = reinterpret_cast<const void*>(description.offset);
+	glEnableVertexAttribArray(description.index);
+	if (description.integer) {
+		glVertexAttribIPointer(description.index, description.size, description.type, description.stride, pointer);
+	} else {
+		glVertexAttribPointer(description.index, description.size, description.type, description.normalized,
+													description.stride, pointer);
+	}
+	CHECK_LAST_GL_CALL;
+}
+
+std::span<const VertexDescription> vertex_descriptions(VertexFormat format) {
+	switch (format) {
+	case VertexFormat::float32:
+		return VertexLayout<Vertex>::attributes;
+	case VertexFormat::half_rgba8:
+		return VertexLayout<HalfVertex>::attributes;
+	case VertexFormat::snorm16_rgba8:
+		return VertexLayout<Snorm16Vertex>::attributes;
+	case VertexFormat::snorm16:
+		return VertexLayout<Snorm16PositionVertex>::attributes;
+	}
+	throw std::runtime_error{std::format("Unknown vertex format {}", std::to_underlying(format))};
+}
+
+constexpr bool has_vertex_color(VertexFormat format) {
+	return format != VertexFormat::snorm16;
+}
+
+// IEEE 754 binary16, rounded to the nearest even
+constexpr Half to_half(float value) {
+	const auto bits = std::bit_cast<std::uint32_t>(value);
+	const auto sign = static_cast<std::uint32_t>((bits >> 16) & 0x8000);
+	const auto biased_exponent = static_cast<int>((bits >> 23) & 0xFF);
+	auto mantissa = bits & 0x7FFFFF;
+
+	if (biased_exponent == 0xFF) {
+		return Half{static_cast<std::uint16_t>(sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0))};
+	}
+
+	const auto exponent = biased_exponent - 127 + 15;
+	if (exponent >= 31) {
+		return Half{static_cast<std::uint16_t>(sign | 0x7C00)};
+	}
+
+	const auto round = [](std::uint32_t half, std::uint32_t rest, std::uint32_t halfway) {
+		return (rest > halfway or (rest == halfway and (half & 1) != 0)) ? half + 1 : half;
+	};
+
+	if (exponent <= 0) {
+		if (exponent < -10) {
+			return Half{static_cast<std::uint16_t>(sign)};
+		}
+		// denormal, the implicit leading one becomes explicit
+		mantissa |= 0x800000;
+		const auto shift = static_cast<std::uint32_t>(14 - exponent);
+		const auto half = mantissa >> shift;
+		return Half{static_cast<std::uint16_t>(sign | round(half, mantissa & ((1u << shift) - 1), 1u << (shift - 1)))};
+	}
+
+	// a carry out of the mantissa correctly bumps the exponent
+	const auto half = (static_cast<std::uint32_t>(exponent) << 10) | (mantissa >> 13);
+	return Half{static_cast<std::uint16_t>(sign | round(half, mantissa & 0x1FFF, 0x1000))};
+}
+
+Snorm16 to_snorm16(float value) {
+	return Snorm16{static_cast<std::int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f))};
+}
+
+std::array<Unorm8, 4> to_rgba8(const vis::vec4& color) {
+	const auto unorm8 = [](float value) {
+		return Unorm8{static_cast<std::uint8_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 255.0f))};
+	};
+	return {unorm8(color.r), unorm8(color.g), unorm8(color.b), unorm8(color.a)};
+}
+
+// For an indexed mesh `first` and `vertex_count` count indices, and base_vertex is added to every index
 struct DrawDescription {
 	GLenum mode;
 	GLint first;
 	GLsizei vertex_count;
+	GLint base_vertex = 0;
 };
 
-class Mesh {
+// Per instance attributes, consumed by the instanced vertex shader at locations 2, 3 and 4
+struct InstanceData {
+	vis::vec4 transform; // position.xy, rotation cos and sin
+	vis::vec2 scale;
+	vis::vec4 color;
+};
+
+constexpr GLuint instance_transform_location = 2;
+constexpr GLuint instance_scale_location = 3;
+constexpr GLuint instance_color_location = 4;
+
+class InstanceBuffer {
 public:
-	explicit Mesh(const std::vector<Vertex>& vertexes, const std::vector<VertexDescription>& vertex_descriptors,
-								const DrawDescription& draw_descriptor)
-			: vao{}, vbo{GL_ARRAY_BUFFER}, vertex_descriptors{vertex_descriptors}, draw_descriptor{draw_descriptor} {
-		vao.bind();
+	InstanceBuffer() : vbo{GL_ARRAY_BUFFER} {}
+
+	void upload(std::span<const InstanceData> instances) {
+		const auto size_in_bytes = instances.size_bytes();
+		capacity = std::max(capacity, std::bit_ceil(size_in_bytes));
+
 		vbo.bind();
+		// orphan the previous storage so the driver doesn't wait for the draws still reading it
+		vbo.data(capacity, nullptr, GL_STREAM_DRAW);
+		vbo.sub_data(0, size_in_bytes, instances.data());
+
+		count = static_cast<GLsizei>(instances.size());
+	}
+
+	[[nodiscard]] GLsizei size() const {
+		return count;
+	}
+
+	explicit operator GLuint() const {
+		return static_cast<GLuint>(vbo);
+	}
+
+	// Unique for the life of the program, unlike the GL name that a buffer created later may take again
+	[[nodiscard]] std::uint64_t identity() const {
+		return id;
+	}
+
+	void bind() const {
+		vbo.bind();
+	}
+
+	void unbind() const {
+		vbo.unbind();
+	}
+
+private:
+	static inline std::atomic<std::uint64_t> next_id{1};
+
+	vis::opengl::VertexBufferObject vbo;
+	std::size_t capacity{};
+	GLsizei count{};
+	std::uint64_t id = next_id.fetch_add(1, std::memory_order_relaxed);
+};
 
-		vbo.data(begin(vertexes), end(vertexes), GL_STATIC_DRAW);
+// Points the instance attributes of the bound VAO at `instances`, starting from `first_instance`
+void attach_instance_attributes(const InstanceBuffer& instances, std::size_t first_instance = 0) {
+	instances.bind();
 
-		for (int i = 0; i < draw_descriptor.vertex_count; i++) {
+	constexpr auto stride = static_cast<GLsizei>(sizeof(InstanceData));
+	const auto offset = first_instance * sizeof(InstanceData);
+	const auto pointer = [&](std::size_t member_offset) { return reinterpret_cast<void*>(offset + member_offset); };
+
+	glEnableVertexAttribArray(instance_transform_location);
+	glVertexAttribPointer(instance_transform_location, 4, GL_FLOAT, GL_FALSE, stride,
+												pointer(offsetof(InstanceData, transform)));
+	glVertexAttribDivisor(instance_transform_location, 1);
+
+	glEnableVertexAttribArray(instance_scale_location);
+	glVertexAttribPointer(instance_scale_location, 2, GL_FLOAT, GL_FALSE, stride, pointer(offsetof(InstanceData, scale)));
+	glVertexAttribDivisor(instance_scale_location, 1);
+
+	glEnableVertexAttribArray(instance_color_location);
+	glVertexAttribPointer(instance_color_location, 4, GL_FLOAT, GL_FALSE, stride, pointer(offsetof(InstanceData, color)));
+	glVertexAttribDivisor(instance_color_location, 1);
+	CHECK_LAST_GL_CALL;
+}
+
+class Mesh {
+public:
+	explicit Mesh(const std::vector<Vertex>& vertexes, VertexFormat format, const DrawDescription& draw_descriptor)
+			: vao{}, vbo{GL_ARRAY_BUFFER}, vertexes{vertexes}, format{format},
+				vertex_descriptors{vertex_descriptions(format)}, draw_descriptor{draw_descriptor} {
+		for (const auto& vertex : vertexes) {
+			radius = std::max(radius, vis::length(vertex.pos));
 		}
 
-		for (auto& vertex_descriptor : vertex_descriptors) {
-			glEnableVertexAttribArray(vertex_descriptor.index);
-			CHECK_LAST_GL_CALL;
+		vao.bind();
+		vbo.bind();
+
+		upload();
 
-			glVertexAttribPointer(vertex_descriptor.index, vertex_descriptor.size, vertex_descriptor.type,
-														vertex_descriptor.normalized, vertex_descriptor.stride, vertex_descriptor.pointer);
+		for (auto& vertex_descriptor : vertex_descriptors) {
+			enable_vertex_attribute(vertex_descriptor);
 		}
 
 		vbo.unbind();
 		vao.unbind();
 	}
 
+	explicit Mesh(const std::vector<Vertex>& vertexes, const std::vector<std::uint32_t>& indexes, VertexFormat format,
+								const DrawDescription& draw_descriptor)
+			: Mesh{vertexes, format, draw_descriptor} {
+		this->indexes = indexes;
+		ebo.emplace();
+
+		vao.bind();
+		ebo->data(indexes, GL_STATIC_DRAW);
+		vao.unbind();
+	}
+
 	void bind() const {
 		vao.bind();
 	}
@@ -77,101 +390,365 @@ public:
 		vao.unbind();
 	}
 
+	// CPU copy of the uploaded vertexes, used by the batcher to transform them on the CPU
+	[[nodiscard]] std::span<const Vertex> vertices() const {
+		return vertexes;
+	}
+
+	// CPU copy of the uploaded indexes, empty when the mesh isn't indexed
+	[[nodiscard]] std::span<const std::uint32_t> indices() const {
+		return indexes;
+	}
+
+	[[nodiscard]] const DrawDescription& draw_description() const {
+		return draw_descriptor;
+	}
+
+	[[nodiscard]] VertexFormat vertex_format() const {
+		return format;
+	}
+
+	// Radius of the circle around the origin holding every vertex, for the culling
+	[[nodiscard]] float bounding_radius() const {
+		return radius;
+	}
+
+	[[nodiscard]] const vis::opengl::VertexArrayObject& vertex_array() const {
+		return vao;
+	}
+
+	// The bindings are left in place, vis::opengl::state_cache() skips them when the next draw uses the same ones
 	void draw(const vis::opengl::Program& program) const {
 		bind();
+		set_constant_color();
 
 		program.use();
-		glDrawArrays(draw_descriptor.mode, draw_descriptor.first, draw_descriptor.vertex_count);
+		if (ebo) {
+			glDrawElementsBaseVertex(draw_descriptor.mode, draw_descriptor.vertex_count, ebo->index_type(), index_offset(),
+															 draw_descriptor.base_vertex);
+		} else {
+			glDrawArrays(draw_descriptor.mode, draw_descriptor.first, draw_descriptor.vertex_count);
+		}
+		CHECK_LAST_GL_CALL;
+	}
+
+	// Draws the mesh once for every instance uploaded in `instances` with a single draw call
+	void draw_instanced(const vis::opengl::Program& program, const InstanceBuffer& instances) const {
+		if (instances.size() == 0) {
+			return;
+		}
+
+		bind();
+		attach(instances);
+		set_constant_color();
 
-		unbind();
+		program.use();
+		if (ebo) {
+			glDrawElementsInstancedBaseVertex(draw_descriptor.mode, draw_descriptor.vertex_count, ebo->index_type(),
+																				index_offset(), instances.size(), draw_descriptor.base_vertex);
+		} else {
+			glDrawArraysInstanced(draw_descriptor.mode, draw_descriptor.first, draw_descriptor.vertex_count,
+														instances.size());
+		}
+		CHECK_LAST_GL_CALL;
+	}
+
+private:
+	// Quantizes the CPU vertexes into the GPU layout, the VBO must be bound
+	void upload() {
+		for (const auto& vertex : vertexes) {
+			if (format_needs_unit_range() and (std::abs(vertex.pos.x) > 1.0f or std::abs(vertex.pos.y) > 1.0f)) {
+				throw std::runtime_error{"snorm16 vertex positions must be inside [-1, 1]"};
+			}
+		}
+
+		if (vertexes.empty()) {
+			return;
+		}
+
+		const auto pack = [&](auto&& pack_vertex) {
+			std::vector<decltype(pack_vertex(vertexes.front()))> packed;
+			packed.reserve(vertexes.size());
+			for (const auto& vertex : vertexes) {
+				packed.push_back(pack_vertex(vertex));
+			}
+			vbo.data(begin(packed), end(packed), GL_STATIC_DRAW);
+		};
+
+		switch (format) {
+		case VertexFormat::float32:
+			vbo.data(begin(vertexes), end(vertexes), GL_STATIC_DRAW);
+			break;
+		case VertexFormat::half_rgba8:
+			pack([](const Vertex& v) { return HalfVertex{{to_half(v.pos.x), to_half(v.pos.y)}, to_rgba8(v.color)}; });
+			break;
+		case VertexFormat::snorm16_rgba8:
+			pack([](const Vertex& v) {
+				return Snorm16Vertex{{to_snorm16(v.pos.x), to_snorm16(v.pos.y)}, to_rgba8(v.color)};
+			});
+			break;
+		case VertexFormat::snorm16:
+			pack([](const Vertex& v) { return Snorm16PositionVertex{{to_snorm16(v.pos.x), to_snorm16(v.pos.y)}}; });
+			break;
+		}
+	}
+
+	[[nodiscard]] bool format_needs_unit_range() const {
+		return format == VertexFormat::snorm16_rgba8 or format == VertexFormat::snorm16;
+	}
+
+	// The current value of a disabled attribute isn't VAO state, so it's set again before every draw
+	void set_constant_color() const {
+		if (not has_vertex_color(format)) {
+			glVertexAttrib4f(1, 1.0f, 1.0f, 1.0f, 1.0f);
+		}
+	}
+
+	[[nodiscard]] const void* index_offset() const {
+		return reinterpret_cast<const void*>(static_cast<std::uintptr_t>(draw_descriptor.first) * ebo->index_size());
+	}
+
+	// The VAO remembers the instance buffer binding, so this only runs the first time a buffer is used. The buffer is
+	// told apart by its identity, a new buffer may get the GL name of a deleted one
+	void attach(const InstanceBuffer& instances) const {
+		if (attached_instances == instances.identity()) {
+			return;
+		}
+
+		attach_instance_attributes(instances);
+		attached_instances = instances.identity();
 	}
 
 private:
 	vis::opengl::VertexArrayObject vao;
 	vis::opengl::VertexBufferObject vbo;
-	std::vector<VertexDescription> vertex_descriptors;
+	std::optional<vis::opengl::ElementBufferObject> ebo;
+	std::vector<Vertex> vertexes;
+	std::vector<std::uint32_t> indexes;
+	VertexFormat format;
+	std::span<const VertexDescription> vertex_descriptors;
 	DrawDescription draw_descriptor;
+	float radius{};
+	mutable std::uint64_t attached_instances{}; // InstanceBuffer::identity, 0 for none
 };
 
-Mesh create_regular_shape(const vis::vec2& center, float radius, const vis::vec4& color, int num_vertices = 6) {
+Mesh create_regular_shape(const vis::vec2& center, float radius, const vis::vec4& color, int num_vertices = 6,
+													VertexFormat format = VertexFormat::float32) {
 	const float theta_step = 2.0f * std::numbers::pi_v<float> / static_cast<float>(num_vertices);
 
 	using VertexVector = std::vector<Vertex>;
 
 	VertexVector vertexes;
-	vertexes.reserve(num_vertices + 2); // plus one for the center, and one for closing
+	vertexes.reserve(num_vertices + 1); // plus one for the center
 	vertexes.emplace_back(center, color);
 	for (int i = 0; i != num_vertices; i++) {
 		auto angle = -theta_step * static_cast<float>(i);
 		vertexes.emplace_back(vis::vec2{std::cos(angle), std::sin(angle)} * radius + center, color);
 	};
-	vertexes.emplace_back(vis::vec2{center.x + radius, center.y}, color);
+
+	// one triangle per segment, the last one closes on the first vertex of the rim
+	std::vector<std::uint32_t> indexes;
+	indexes.reserve(num_vertices * 3);
+	for (std::uint32_t i = 1; i <= static_cast<std::uint32_t>(num_vertices); i++) {
+		indexes.insert(indexes.end(), {0, i, i % static_cast<std::uint32_t>(num_vertices) + 1});
+	}
 
 	auto draw_description = DrawDescription{
-			.mode = GL_TRIANGLE_FAN,
+			.mode = GL_TRIANGLES,
 			.first = 0,
-			.vertex_count = static_cast<GLsizei>(vertexes.size()),
-	};
-	auto vertex_descriptions = std::vector<VertexDescription>{
-			VertexDescription{
-					.index = 0,
-					.size = 2,
-					.type = GL_FLOAT,
-					.normalized = GL_FALSE,
-					.stride = sizeof(Vertex),
-					.pointer = nullptr,
-			},
-			VertexDescription{
-					.index = 1,
-					.size = 4,
-					.type = GL_FLOAT,
-					.normalized = GL_FALSE,
-					.stride = sizeof(Vertex),
-					.pointer = reinterpret_cast<void*>(sizeof(vis::vec2)),
-			},
+			.vertex_count = static_cast<GLsizei>(indexes.size()),
 	};
-	return Mesh{vertexes, vertex_descriptions, draw_description};
+	return Mesh{vertexes, indexes, format, draw_description};
 }
 
-Mesh create_rectangle_shape(const vis::vec2& center, const vis::vec2& half_extent, vis::vec4 color = vis::vec4{}) {
+Mesh create_rectangle_shape(const vis::vec2& center, const vis::vec2& half_extent, vis::vec4 color = vis::vec4{},
+														VertexFormat format = VertexFormat::float32) {
 	vis::vec2 up = vis::vec2(0.0f, half_extent.y);
 	vis::vec2 down = vis::vec2(0.0f, -half_extent.y);
 	vis::vec2 left = vis::vec2(-half_extent.x, 0.0f);
 	vis::vec2 right = vis::vec2(half_extent.x, 0.0f);
 
 	std::vector<Vertex> vertexes;
-	vertexes.reserve(6);
+	vertexes.reserve(4);
 	vertexes.emplace_back(center + down + left, color);
 	vertexes.emplace_back(center + down + right, color);
 	vertexes.emplace_back(center + up + right, color);
-	vertexes.emplace_back(center + down + left, color);
-	vertexes.emplace_back(center + up + right, color);
 	vertexes.emplace_back(center + up + left, color);
 
+	const auto indexes = std::vector<std::uint32_t>{0, 1, 2, 0, 2, 3};
+
 	auto draw_description = DrawDescription{
 			.mode = GL_TRIANGLES,
 			.first = 0,
-			.vertex_count = static_cast<GLsizei>(vertexes.size()),
+			.vertex_count = static_cast<GLsizei>(indexes.size()),
 	};
-	auto vertex_descriptions = std::vector<VertexDescription>{
-			VertexDescription{
-					.index = 0,
-					.size = 2,
-					.type = GL_FLOAT,
-					.normalized = GL_FALSE,
-					.stride = sizeof(Vertex),
-					.pointer = nullptr,
-			},
-			VertexDescription{
-					.index = 1,
-					.size = 4,
-					.type = GL_FLOAT,
-					.normalized = GL_FALSE,
-					.stride = sizeof(Vertex),
-					.pointer = reinterpret_cast<void*>(sizeof(vis::vec2)),
-			},
-	};
-	return Mesh{vertexes, vertex_descriptions, draw_description};
+	return Mesh{vertexes, indexes, format, draw_description};
 }
 
+// Geometry of several meshes packed in one vertex buffer and one index buffer behind a single VAO, so that one multi
+// draw call can draw any of them. Only triangle lists are pooled.
+class MeshPool {
+public:
+	struct Range {
+		GLuint first_index;
+		GLuint index_count;
+		GLint base_vertex;
+	};
+
+	MeshPool() : vbo{GL_ARRAY_BUFFER} {}
+
+	MeshPool(const MeshPool&) = delete;
+	MeshPool& operator=(const MeshPool&) = delete;
+
+	// Copies the geometry of `mesh` in the pool and returns its slot, the GPU buffers are updated on the next bind
+	std::uint32_t add(const Mesh& mesh) {
+		const auto& draw = mesh.draw_description();
+		if (draw.mode != GL_TRIANGLES) {
+			throw std::runtime_error{"Only triangle lists can be pooled"};
+		}
+
+		const auto range = Range{
+				.first_index = static_cast<GLuint>(indexes.size()),
+				.index_count = static_cast<GLuint>(draw.vertex_count),
+				.base_vertex = static_cast<GLint>(vertexes.size()),
+		};
+
+		const auto mesh_vertices = mesh.vertices();
+		const auto mesh_indices = mesh.indices();
+		vertexes.insert(vertexes.end(), mesh_vertices.begin(), mesh_vertices.end());
+		for (GLsizei i = 0; i != draw.vertex_count; ++i) {
+			const auto n = static_cast<std::size_t>(draw.first + i);
+			indexes.push_back(mesh_indices.empty() ? static_cast<std::uint32_t>(n) : mesh_indices[n] + draw.base_vertex);
+		}
+
+		ranges.push_back(range);
+		dirty = true;
+		return static_cast<std::uint32_t>(ranges.size() - 1);
+	}
+
+	[[nodiscard]] const Range& range(std::uint32_t slot) const {
+		return ranges[slot];
+	}
+
+	[[nodiscard]] std::size_t size() const {
+		return ranges.size();
+	}
+
+	[[nodiscard]] GLenum index_type() const {
+		return ebo.index_type();
+	}
+
+	[[nodiscard]] std::size_t index_size() const {
+		return ebo.index_size();
+	}
+
+	void bind() {
+		vao.bind();
+		if (not dirty) {
+			return;
+		}
+
+		vbo.bind();
+		vbo.data(vertexes.size() * sizeof(Vertex), vertexes.data(), GL_STATIC_DRAW);
+		ebo.data(indexes, GL_STATIC_DRAW);
+
+		for (const auto& attribute : VertexLayout<Vertex>::attributes) {
+			enable_vertex_attribute(attribute);
+		}
+
+		dirty = false;
+	}
+
+private:
+	vis::opengl::VertexArrayObject vao;
+	vis::opengl::VertexBufferObject vbo;
+	vis::opengl::ElementBufferObject ebo;
+	std::vector<Vertex> vertexes;
+	std::vector<std::uint32_t> indexes;
+	std::vector<Range> ranges;
+	bool dirty = false;
+};
+
+enum class ShapeKind {
+	regular_polygon,
+	rectangle,
+	circle,
+};
+
+// Entity components: the geometry is shared, size goes through Transformation::scale and color is kept apart
+struct MeshRef {
+	const Mesh* mesh;
+};
+
+struct Color {
+	vis::vec4 value{1.0f};
+};
+
+// Owns one unit sized, white mesh per shape kind and segment count. The entities reference the geometry through
+// MeshRef, so the number of VAOs and VBOs doesn't depend on how many entities are spawned.
+// The meshes are white and unit sized, so by default they are stored as bare snorm16 positions, 4 bytes per vertex.
+class MeshLibrary {
+public:
+	explicit MeshLibrary(VertexFormat format = VertexFormat::snorm16) : format{format} {}
+
+	MeshLibrary(const MeshLibrary&) = delete;
+	MeshLibrary& operator=(const MeshLibrary&) = delete;
+
+	// Circle of radius 1 centered in the origin
+	const Mesh& regular_shape(int segments) {
+		return get(ShapeKind::regular_polygon, segments);
+	}
+
+	// Square of half extent 1 centered in the origin
+	const Mesh& rectangle() {
+		return get(ShapeKind::rectangle, 4);
+	}
+
+	// Quad around the circle of radius 1 centered in the origin, 4 vertexes whatever the size on screen. The circle is
+	// cut out by vis::shaders::circle_fragment, drawn with vis::shaders::instanced_circle_vertex
+	const Mesh& circle() {
+		return get(ShapeKind::circle, 4);
+	}
+
+	const Mesh& get(ShapeKind kind, int segments) {
+		const auto key = Key{kind, segments};
+		if (auto it = meshes.find(key); it != meshes.end()) {
+			return it->second;
+		}
+
+		return meshes.emplace(key, create(kind, segments)).first->second;
+	}
+
+	[[nodiscard]] std::size_t size() const {
+		return meshes.size();
+	}
+
+private:
+	struct Key {
+		ShapeKind kind;
+		int segments;
+
+		auto operator<=>(const Key&) const = default;
+	};
+
+	Mesh create(ShapeKind kind, int segments) const {
+		constexpr auto origin = vis::vec2{0.0f, 0.0f};
+		constexpr auto white = vis::vec4{1.0f, 1.0f, 1.0f, 1.0f};
+
+		switch (kind) {
+		case ShapeKind::regular_polygon:
+			return create_regular_shape(origin, 1.0f, white, segments, format);
+		case ShapeKind::rectangle:
+		case ShapeKind::circle:
+			return create_rectangle_shape(origin, vis::vec2{1.0f, 1.0f}, white, format);
+		}
+		throw std::runtime_error{std::format("Unknown shape kind {}", std::to_underlying(kind))};
+	}
+
+private:
+	VertexFormat format;
+	// std::map never moves its nodes, so the references handed out stay valid
+	std::map<Key, Mesh> meshes;
+};
+
 } // namespace vis::mesh
\ No newline at end of file
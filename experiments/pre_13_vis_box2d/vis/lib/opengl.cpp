@@ -28,14 +28,125 @@ import :math;
 
 export namespace vis::opengl {
 
+struct StateStats {
+	std::uint64_t issued{};
+	std::uint64_t elided{};
+};
+
+// Shadows the bindings of the current context so binding what is already bound costs no GL call. Every bind of a
+// program, vertex array, array buffer and the viewport must go through here, otherwise the shadow goes stale; call
+// invalidate() after code that touches the GL state directly.
+class StateCache {
+public:
+	void use_program(GLuint id) {
+		if (update(program, id)) {
+			glUseProgram(id);
+			CHECK_LAST_GL_CALL;
+		}
+	}
+
+	void bind_vertex_array(GLuint id) {
+		if (update(vertex_array, id)) {
+			glBindVertexArray(id);
+			CHECK_LAST_GL_CALL;
+		}
+	}
+
+	void bind_buffer(GLenum target, GLuint id) {
+		if (target != GL_ARRAY_BUFFER) {
+			glBindBuffer(target, id);
+			CHECK_LAST_GL_CALL;
+			++current_frame.issued;
+			return;
+		}
+
+		if (update(array_buffer, id)) {
+			glBindBuffer(target, id);
+			CHECK_LAST_GL_CALL;
+		}
+	}
+
+	void viewport(int x, int y, int width, int height) {
+		if (update(current_viewport, std::array{x, y, width, height})) {
+			glViewport(x, y, width, height);
+			CHECK_LAST_GL_CALL;
+		}
+	}
+
+	// OpenGL unbinds the deleted objects, the shadow must do the same
+	void forget_program(GLuint id) {
+		forget(program, id);
+	}
+
+	void forget_vertex_array(GLuint id) {
+		forget(vertex_array, id);
+	}
+
+	void forget_buffer(GLuint id) {
+		forget(array_buffer, id);
+	}
+
+	void invalidate() {
+		program.reset();
+		vertex_array.reset();
+		array_buffer.reset();
+		current_viewport.reset();
+	}
+
+	void end_frame() {
+		last_frame = std::exchange(current_frame, {});
+	}
+
+	// Counters of the last completed frame
+	[[nodiscard]] const StateStats& frame_stats() const {
+		return last_frame;
+	}
+
+private:
+	template <typename T> bool update(std::optional<T>& shadow, const T& value) {
+		if (shadow == value) {
+			++current_frame.elided;
+			return false;
+		}
+
+		shadow = value;
+		++current_frame.issued;
+		return true;
+	}
+
+	static void forget(std::optional<GLuint>& shadow, GLuint id) {
+		if (shadow == id) {
+			shadow = 0;
+		}
+	}
+
+private:
+	// std::nullopt means unknown, the next bind is always issued
+	std::optional<GLuint> program;
+	std::optional<GLuint> vertex_array;
+	std::optional<GLuint> array_buffer;
+	std::optional<std::array<int, 4>> current_viewport;
+
+	StateStats current_frame;
+	StateStats last_frame;
+};
+
+// There is a single OpenGL context, created by vis::engine::create
+StateCache& state_cache() {
+	static StateCache cache;
+	return cache;
+}
+
 struct VertexArrayObject {
 	VertexArrayObject() {
 		glGenVertexArrays(1, &id);
 	}
 
 	~VertexArrayObject() {
-		if (id != 0)
+		if (id != 0) {
+			state_cache().forget_vertex_array(id);
 			glDeleteVertexArrays(1, &id);
+		}
 	}
 
 	VertexArrayObject(VertexArrayObject&) = delete;
@@ -53,11 +164,11 @@ struct VertexArrayObject {
 	}
 
 	void bind() const {
-		glBindVertexArray(id);
+		state_cache().bind_vertex_array(id);
 	}
 
 	static void unbind() {
-		glBindVertexArray(0);
+		state_cache().bind_vertex_array(0);
 	}
 
 	explicit operator GLuint() const {
@@ -73,32 +184,32 @@ struct VertexBufferObject {
 	}
 
 	~VertexBufferObject() {
-		if (id != 0)
+		if (id != 0) {
+			state_cache().forget_buffer(id);
 			glDeleteBuffers(1, &id);
+		}
 	}
 
 	VertexBufferObject(VertexBufferObject&) = delete;
 
 	VertexBufferObject& operator=(VertexBufferObject&) = delete;
 
-	VertexBufferObject(VertexBufferObject&& rhs) noexcept : id{rhs.id} {
+	VertexBufferObject(VertexBufferObject&& rhs) noexcept : type{rhs.type}, id{rhs.id} {
 		rhs.id = 0;
 	}
 
 	VertexBufferObject& operator=(VertexBufferObject&& rhs) noexcept {
-		id = rhs.id;
-		rhs.id = 0;
+		std::swap(type, rhs.type);
+		std::swap(id, rhs.id);
 		return *this;
 	}
 
 	void bind() const {
-		glBindBuffer(type, id);
-		CHECK_LAST_GL_CALL;
+		state_cache().bind_buffer(type, id);
 	}
 
 	void unbind() const {
-		glBindBuffer(type, 0);
-		CHECK_LAST_GL_CALL;
+		state_cache().bind_buffer(type, 0);
 	}
 
 	template <typename ConstRandomIterator> void data(ConstRandomIterator begin, ConstRandomIterator end, GLenum usage) {
@@ -118,6 +229,11 @@ struct VertexBufferObject {
 		CHECK_LAST_GL_CALL;
 	}
 
+	void sub_data(std::size_t offset, std::size_t size, const void* data) const {
+		glBufferSubData(type, static_cast<GLintptr>(offset), static_cast<GLsizeiptr>(size), data);
+		CHECK_LAST_GL_CALL;
+	}
+
 	explicit operator GLuint() const {
 		return id;
 	}
@@ -126,6 +242,55 @@ struct VertexBufferObject {
 	GLuint id{};
 };
 
+// Index buffer. The binding is part of the vertex array state, so it must be bound while the owning VAO is bound and
+// it's never unbound.
+class ElementBufferObject {
+public:
+	ElementBufferObject() : buffer{GL_ELEMENT_ARRAY_BUFFER} {}
+
+	// Stores the indices with 16 bits when all of them fit, with 32 bits otherwise
+	void data(std::span<const std::uint32_t> indices, GLenum usage) {
+		const auto max_index = indices.empty() ? 0u : std::ranges::max(indices);
+		count = static_cast<GLsizei>(indices.size());
+
+		buffer.bind();
+		if (max_index <= std::numeric_limits<std::uint16_t>::max()) {
+			type = GL_UNSIGNED_SHORT;
+			std::vector<std::uint16_t> narrow(indices.begin(), indices.end());
+			buffer.data(narrow.size() * sizeof(std::uint16_t), narrow.data(), usage);
+		} else {
+			type = GL_UNSIGNED_INT;
+			buffer.data(indices.size_bytes(), indices.data(), usage);
+		}
+	}
+
+	void bind() const {
+		buffer.bind();
+	}
+
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	[[nodiscard]] GLenum index_type() const {
+		return type;
+	}
+
+	[[nodiscard]] std::size_t index_size() const {
+		return type == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+	}
+
+	[[nodiscard]] GLsizei size() const {
+		return count;
+	}
+
+	explicit operator GLuint() const {
+		return static_cast<GLuint>(buffer);
+	}
+
+private:
+	VertexBufferObject buffer;
+	GLenum type{GL_UNSIGNED_SHORT};
+	GLsizei count{};
+};
+
 enum class ShaderType {
 	vertex,
 	geometry,
@@ -158,6 +323,14 @@ GLenum to_opengl(ShaderType type) {
 class Shader {
 public:
 	static Shader create(ShaderType type, std::string_view source) {
+		auto shader = Shader{to_opengl(type), source};
+		static_cast<void>(shader.check());
+		return shader;
+	}
+
+	// Only starts the compilation, querying the status right away would wait for the driver to finish it. The status is
+	// checked with check(), or through the program the shader is linked in.
+	static Shader compile(ShaderType type, std::string_view source) {
 		return Shader{to_opengl(type), source};
 	}
 
@@ -185,16 +358,8 @@ public:
 		return id;
 	}
 
-private:
-	explicit Shader(GLenum type, std::string_view source) : type{type}, id{glCreateShader(type)} {
-		char const* source_pointer = source.data();
-		glShaderSource(id, 1, &(source_pointer), nullptr);
-		CHECK_LAST_GL_CALL;
-
-		glCompileShader(id);
-		CHECK_LAST_GL_CALL;
-
-		// Check Vertex Shader
+	// Waits for the compilation and prints the log, if any
+	[[nodiscard]] bool check() const {
 		GLint res = GL_FALSE;
 		GLint info_log_len = 0;
 		glGetShaderiv(id, GL_COMPILE_STATUS, &res);
@@ -211,6 +376,19 @@ private:
 
 			std::println("Shader compilation error: {}", message);
 		};
+
+		return res == GL_TRUE;
+	}
+
+private:
+	explicit Shader(GLenum type, std::string_view source) : type{type}, id{glCreateShader(type)} {
+		char const* source_pointer = source.data();
+		const auto source_length = static_cast<GLint>(source.size());
+		glShaderSource(id, 1, &(source_pointer), &source_length);
+		CHECK_LAST_GL_CALL;
+
+		glCompileShader(id);
+		CHECK_LAST_GL_CALL;
 	}
 
 private:
@@ -218,28 +396,123 @@ private:
 	GLuint id;
 };
 
+// FNV-1a, constexpr so the names written as literals are hashed at compile time
+constexpr std::uint32_t hash_name(std::string_view name) {
+	std::uint32_t hash = 2166136261u;
+	for (const char c : name) {
+		hash ^= static_cast<std::uint8_t>(c);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// FNV-1a on 64 bits, chained through `hash` to hash several strings
+constexpr std::uint64_t hash_bytes(std::string_view bytes, std::uint64_t hash = 14695981039346656037ull) {
+	for (const char c : bytes) {
+		hash ^= static_cast<std::uint8_t>(c);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Name of a uniform hashed at compile time, e.g. program.uniform<vis::mat4>("model_view_projection")
+struct UniformName {
+	template <std::size_t N>
+	consteval UniformName(const char (&literal)[N]) : hash{hash_name({literal, N - 1})}, name{literal, N - 1} {}
+
+	explicit constexpr UniformName(std::string_view name) : hash{hash_name(name)}, name{name} {}
+
+	std::uint32_t hash;
+	std::string_view name;
+};
+
+template <typename T> consteval GLenum uniform_type_of() {
+	if constexpr (std::is_same_v<T, float>) {
+		return GL_FLOAT;
+	} else if constexpr (std::is_same_v<T, int>) {
+		return GL_INT;
+	} else if constexpr (std::is_same_v<T, vis::vec2>) {
+		return GL_FLOAT_VEC2;
+	} else if constexpr (std::is_same_v<T, vis::vec4>) {
+		return GL_FLOAT_VEC4;
+	} else if constexpr (std::is_same_v<T, vis::mat3>) {
+		return GL_FLOAT_MAT3;
+	} else {
+		static_assert(std::is_same_v<T, vis::mat4>, "Unsupported uniform type");
+		return GL_FLOAT_MAT4;
+	}
+}
+
+// Location of an active uniform of type T, resolved once through Program::uniform. Setting an invalid handle is a
+// no-op, as it is for the location -1 in OpenGL.
+template <typename T> struct UniformHandle {
+	GLint location{-1};
+
+	[[nodiscard]] bool is_valid() const {
+		return location != -1;
+	}
+};
+
+// Driver specific image of a linked program, only valid for the driver that produced it
+struct ProgramBinary {
+	GLenum format;
+	std::vector<std::byte> data;
+};
+
 class Program {
 public:
-	static std::optional<Program> create(std::vector<Shader> shaders) {
-		return Program{std::move(shaders)};
+	friend class PendingProgram;
+
+	// `retrievable` asks the driver to keep the binary around for binary()
+	static std::optional<Program> create(std::vector<Shader> shaders, bool retrievable = false) {
+		return Program{std::move(shaders), retrievable};
+	}
+
+	// Fails, instead of linking a broken program, when the driver doesn't accept the binary anymore (e.g. after an
+	// update), so the caller can build from the sources
+	static std::optional<Program> from_binary(const ProgramBinary& binary) {
+		// also asserts that no earlier call left an error behind, the one read below belongs to glProgramBinary
+		const auto id = glCreateProgram();
+		CHECK_LAST_GL_CALL;
+
+		// a rejected binary is reported as GL_INVALID_ENUM by some drivers, it's expected here
+		glProgramBinary(id, binary.format, binary.data.data(), static_cast<GLsizei>(binary.data.size()));
+		const auto error = glGetError();
+
+		GLint result = GL_FALSE;
+		glGetProgramiv(id, GL_LINK_STATUS, &result);
+		CHECK_LAST_GL_CALL;
+
+		if (error != GL_NO_ERROR or result != GL_TRUE) {
+			glDeleteProgram(id);
+			return std::nullopt;
+		}
+
+		return Program{id};
 	}
 
 	Program(const Program&) = delete;
 
 	Program& operator=(const Program&) = delete;
 
-	Program(Program&& other) noexcept : id{other.id} {
+	Program(Program&& other) noexcept
+			: id{other.id}, linked{other.linked}, uniforms{std::move(other.uniforms)},
+				reported_uniforms{std::move(other.reported_uniforms)} {
 		other.id = 0;
 	}
 
 	Program& operator=(Program&& rhs) noexcept {
 		std::swap(id, rhs.id);
+		std::swap(linked, rhs.linked);
+		std::swap(uniforms, rhs.uniforms);
+		std::swap(reported_uniforms, rhs.reported_uniforms);
 		return *this;
 	}
 
 	~Program() {
 		if (id != 0) {
-			glDeleteShader(id);
+			state_cache().forget_program(id);
+			glDeleteProgram(id);
 			CHECK_LAST_GL_CALL;
 		}
 	}
@@ -248,33 +521,80 @@ public:
 		return id;
 	}
 
-	void use() const {
-		glUseProgram(id);
+	[[nodiscard]] bool is_linked() const {
+		return linked;
 	}
 
-	void set_uniform(std::string_view name, const vis::mat3& m) {
-		// TODO: make it a concept for VectorConcept and MatrixConcept so we can write this as:
-		// template<typename T> requires IsVector<T> or IsMatrix<T>
-		const auto loc = get_or_update_uniform(name);
-		glUniformMatrix3fv(loc, 1, GL_FALSE, vis::gtc::value_ptr(m));
+	// Empty when the program wasn't created retrievable or the driver has no binary format
+	[[nodiscard]] std::optional<ProgramBinary> binary() const {
+		GLint length = 0;
+		glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
 		CHECK_LAST_GL_CALL;
-	}
+		if (length <= 0) {
+			return std::nullopt;
+		}
 
-	void set_uniform(std::string_view name, const vis::mat4& m) {
-		// TODO: make it a concept for VectorConcept and MatrixConcept so we can write this as:
-		// template<typename T> requires IsVector<T> or IsMatrix<T>
-		const auto loc = get_or_update_uniform(name);
-		glUniformMatrix4fv(loc, 1, GL_FALSE, vis::gtc::value_ptr(m));
+		auto binary = ProgramBinary{.format = GL_NONE, .data = std::vector<std::byte>(static_cast<std::size_t>(length))};
+		glGetProgramBinary(id, length, nullptr, &binary.format, binary.data.data());
 		CHECK_LAST_GL_CALL;
+		return binary;
+	}
+
+	void use() const {
+		state_cache().use_program(id);
+	}
+
+	// Looks up a uniform among the ones found at link time, meant to be called once and the handle kept around. A
+	// missing uniform, misspelt or optimised out, is reported on its first lookup only
+	template <typename T> [[nodiscard]] UniformHandle<T> uniform(UniformName name) const {
+		const auto* active_uniform = find_uniform(name);
+		if (active_uniform == nullptr or active_uniform->type != uniform_type_of<T>()) {
+			if (not std::ranges::contains(reported_uniforms, name.name)) {
+				reported_uniforms.emplace_back(name.name);
+				std::println("Uniform {} not found or of a different type", name.name);
+			}
+			return {};
+		}
+
+		return UniformHandle<T>{active_uniform->location};
+	}
+
+	// The program must be in use
+	template <typename T> void set(UniformHandle<T> uniform, const std::type_identity_t<T>& value) const {
+		upload(uniform.location, value);
 	}
 
 	static void unbind() {
-		glUseProgram(0);
-		CHECK_LAST_GL_CALL;
+		state_cache().use_program(0);
 	}
 
 private:
-	explicit Program(std::vector<Shader>&& shaders) : id{glCreateProgram()} {
+	struct ActiveUniform {
+		std::uint32_t hash;
+		std::string name;
+		GLint location;
+		GLenum type;
+	};
+
+	explicit Program(GLuint linked_id) : id{linked_id}, linked{true} {
+		resolve_uniforms();
+	}
+
+	explicit Program(std::vector<Shader>&& shaders, bool retrievable)
+			: id{start_link(shaders, retrievable)}, linked{check_link(id)} {
+		if (linked) {
+			resolve_uniforms();
+		}
+	}
+
+	// Doesn't wait for the driver, the status is queried by check_link
+	static GLuint start_link(const std::vector<Shader>& shaders, bool retrievable) {
+		const auto id = glCreateProgram();
+		if (retrievable) {
+			glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			CHECK_LAST_GL_CALL;
+		}
+
 		for (const auto& shader : shaders) {
 			glAttachShader(id, static_cast<GLuint>(shader));
 			CHECK_LAST_GL_CALL;
@@ -282,7 +602,10 @@ private:
 
 		glLinkProgram(id);
 		CHECK_LAST_GL_CALL;
+		return id;
+	}
 
+	static bool check_link(GLuint id) {
 		GLint result = GL_FALSE;
 		GLint info_log_len = 0;
 
@@ -301,27 +624,163 @@ private:
 
 			std::println("Link error: {}", message);
 		}
+
+		return result == GL_TRUE;
 	}
 
-	GLint get_uniform_id(std::string_view name) const {
-		auto res = glGetUniformLocation(id, name.data());
+	void resolve_uniforms() {
+		GLint uniform_count = 0;
+		GLint max_name_len = 0;
+		glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &uniform_count);
+		glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_name_len);
 		CHECK_LAST_GL_CALL;
 
-		return res;
-	}
+		std::string name(static_cast<std::size_t>(max_name_len), '\0');
+		uniforms.reserve(uniform_count);
+
+		for (GLint i = 0; i != uniform_count; ++i) {
+			GLsizei name_len = 0;
+			GLint size = 0;
+			GLenum type = GL_NONE;
+			glGetActiveUniform(id, static_cast<GLuint>(i), max_name_len, &name_len, &size, &type, name.data());
+			CHECK_LAST_GL_CALL;
+
+			// the location of an array is the location of its first element
+			auto uniform_name = std::string_view{name.data(), static_cast<std::size_t>(name_len)};
+			if (uniform_name.ends_with("[0]")) {
+				uniform_name.remove_suffix(3);
+			}
+
+			const auto location = glGetUniformLocation(id, name.c_str());
+			CHECK_LAST_GL_CALL;
 
-	GLint get_or_update_uniform(std::string_view name) {
-		auto it = uniforms.find(name);
-		if (it != uniforms.end()) {
-			return it->second;
+			// uniforms in blocks have no location
+			if (location != -1) {
+				uniforms.push_back(ActiveUniform{hash_name(uniform_name), std::string{uniform_name}, location, type});
+			}
 		}
 
-		return uniforms[name] = get_uniform_id(name);
+		std::ranges::sort(uniforms, {}, &ActiveUniform::hash);
+	}
+
+	// The hash finds the candidates, the name tells them apart when two names collide
+	const ActiveUniform* find_uniform(const UniformName& name) const {
+		const auto candidates = std::ranges::equal_range(uniforms, name.hash, {}, &ActiveUniform::hash);
+		const auto it = std::ranges::find(candidates, name.name, &ActiveUniform::name);
+		return it != candidates.end() ? &(*it) : nullptr;
+	}
+
+	static void upload(GLint location, float value) {
+		glUniform1f(location, value);
+		CHECK_LAST_GL_CALL;
+	}
+
+	static void upload(GLint location, int value) {
+		glUniform1i(location, value);
+		CHECK_LAST_GL_CALL;
+	}
+
+	static void upload(GLint location, const vis::vec2& v) {
+		glUniform2fv(location, 1, vis::gtc::value_ptr(v));
+		CHECK_LAST_GL_CALL;
+	}
+
+	static void upload(GLint location, const vis::vec4& v) {
+		glUniform4fv(location, 1, vis::gtc::value_ptr(v));
+		CHECK_LAST_GL_CALL;
+	}
+
+	static void upload(GLint location, const vis::mat3& m) {
+		glUniformMatrix3fv(location, 1, GL_FALSE, vis::gtc::value_ptr(m));
+		CHECK_LAST_GL_CALL;
+	}
+
+	static void upload(GLint location, const vis::mat4& m) {
+		glUniformMatrix4fv(location, 1, GL_FALSE, vis::gtc::value_ptr(m));
+		CHECK_LAST_GL_CALL;
 	}
 
 private:
 	GLuint id;
-	std::map<std::string_view, GLint> uniforms;
+	bool linked = false;
+	std::vector<ActiveUniform> uniforms;
+	mutable std::vector<std::string> reported_uniforms; // looked up and missing, reported already
+};
+
+// Program the driver is compiling and linking, see ProgramBuilder::build_async. With KHR_parallel_shader_compile
+// poll() never blocks; without it the driver may still compile in the background, but the first poll waits for it.
+class PendingProgram {
+public:
+	using LinkedCallback = std::move_only_function<void(const Program&)>;
+
+	// Already finished, e.g. loaded from the binary cache
+	explicit PendingProgram(std::optional<Program> program, bool from_cache)
+			: result{std::move(program)}, from_cache{from_cache}, finished{true} {}
+
+	explicit PendingProgram(std::vector<Shader> shaders, LinkedCallback on_linked = {})
+			: shaders{std::move(shaders)}, id{Program::start_link(this->shaders, static_cast<bool>(on_linked))},
+				on_linked{std::move(on_linked)} {}
+
+	PendingProgram(const PendingProgram&) = delete;
+	PendingProgram& operator=(const PendingProgram&) = delete;
+
+	~PendingProgram() {
+		if (id != 0) {
+			glDeleteProgram(id);
+		}
+	}
+
+	// Returns true once the build is over, successful or not
+	bool poll() {
+		if (finished) {
+			return true;
+		}
+
+		if (GLEW_KHR_parallel_shader_compile) {
+			GLint completed = GL_FALSE;
+			glGetProgramiv(id, GL_COMPLETION_STATUS_KHR, &completed);
+			if (completed != GL_TRUE) {
+				return false;
+			}
+		}
+
+		finished = true;
+		const auto program_id = std::exchange(id, 0);
+		if (not Program::check_link(program_id)) {
+			for (const auto& shader : shaders) {
+				static_cast<void>(shader.check());
+			}
+			glDeleteProgram(program_id);
+		} else {
+			result.emplace(Program{program_id});
+			if (on_linked) {
+				on_linked(*result);
+			}
+		}
+		shaders.clear();
+		return true;
+	}
+
+	[[nodiscard]] bool is_ready() const {
+		return finished;
+	}
+
+	[[nodiscard]] bool loaded_from_cache() const {
+		return from_cache;
+	}
+
+	// Moves the program out once ready, empty when the build failed
+	[[nodiscard]] std::optional<Program> take() {
+		return std::exchange(result, std::nullopt);
+	}
+
+private:
+	std::vector<Shader> shaders;
+	GLuint id = 0;
+	LinkedCallback on_linked;
+	std::optional<Program> result;
+	bool from_cache = false;
+	bool finished = false;
 };
 
 class ProgramBuilder {
@@ -331,12 +790,171 @@ public:
 		return *this;
 	}
 
+	// The source is compiled by build, and only when the program isn't found in the binary cache
+	ProgramBuilder& add_shader(ShaderType type, std::string_view source) {
+		sources.emplace_back(type, std::string{source});
+		return *this;
+	}
+
+	// Programs built only from sources are loaded from `directory` with glProgramBinary when the sources and the
+	// driver are the same as the last time, otherwise they are compiled and their binary is stored there
+	ProgramBuilder& with_binary_cache(std::filesystem::path directory) {
+		cache_directory = std::move(directory);
+		return *this;
+	}
+
 	[[nodiscard]] std::optional<Program> build() {
-		return Program::create(std::move(shaders));
+		from_cache = false;
+		if (cache_directory.empty() or not shaders.empty()) {
+			compile_sources();
+			return Program::create(std::move(shaders));
+		}
+
+		const auto key = cache_key();
+		const auto path = cache_directory / std::format("{:016x}.bin", key);
+		if (auto binary = load_binary(path, key)) {
+			if (auto program = Program::from_binary(*binary)) {
+				from_cache = true;
+				return program;
+			}
+			std::println("Stale program binary {}, building from the sources", path.string());
+		}
+
+		compile_sources();
+		auto program = Program::create(std::move(shaders), true);
+		if (program and program->is_linked()) {
+			if (const auto binary = program->binary()) {
+				save_binary(path, key, *binary);
+			}
+		}
+		return program;
+	}
+
+	// Same as build, but returns as soon as the driver has the work: poll the handle, or let the Engine poll it, until
+	// it's ready. A binary cache hit is ready right away.
+	[[nodiscard]] std::shared_ptr<PendingProgram> build_async() {
+		from_cache = false;
+		if (cache_directory.empty() or not shaders.empty()) {
+			compile_sources(false);
+			return std::make_shared<PendingProgram>(std::move(shaders));
+		}
+
+		const auto key = cache_key();
+		auto path = cache_directory / std::format("{:016x}.bin", key);
+		if (auto binary = load_binary(path, key)) {
+			if (auto program = Program::from_binary(*binary)) {
+				from_cache = true;
+				return std::make_shared<PendingProgram>(std::move(program), true);
+			}
+		}
+
+		compile_sources(false);
+		return std::make_shared<PendingProgram>(std::move(shaders), [path = std::move(path), key](const Program& program) {
+			if (const auto binary = program.binary()) {
+				save_binary(path, key, *binary);
+			}
+		});
+	}
+
+	// Whether the last build was loaded from the binary cache
+	[[nodiscard]] bool loaded_from_cache() const {
+		return from_cache;
+	}
+
+private:
+	struct BinaryHeader {
+		std::uint32_t magic;
+		GLenum format;
+		std::uint64_t key;
+		std::uint64_t size;
+	};
+
+	static constexpr std::uint32_t binary_magic = 0x42505356; // "VSPB"
+
+	void compile_sources(bool wait = true) {
+		for (const auto& [type, source] : sources) {
+			shaders.push_back(wait ? Shader::create(type, source) : Shader::compile(type, source));
+		}
+		sources.clear();
+	}
+
+	// A driver update changes the version string, so it invalidates the binaries too
+	[[nodiscard]] std::uint64_t cache_key() const {
+		const auto gl_string = [](GLenum name) {
+			const auto* value = reinterpret_cast<const char*>(glGetString(name));
+			return std::string_view{value != nullptr ? value : ""};
+		};
+
+		auto hash = hash_bytes(gl_string(GL_VENDOR));
+		hash = hash_bytes(gl_string(GL_RENDERER), hash);
+		hash = hash_bytes(gl_string(GL_VERSION), hash);
+		for (const auto& [type, source] : sources) {
+			hash = hash_bytes(std::to_string(to_opengl(type)), hash);
+			hash = hash_bytes(source, hash);
+		}
+		return hash;
+	}
+
+	static std::optional<ProgramBinary> load_binary(const std::filesystem::path& path, std::uint64_t key) {
+		std::ifstream in{path, std::ios::binary};
+		if (not in) {
+			return std::nullopt;
+		}
+
+		BinaryHeader header{};
+		in.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (not in or header.magic != binary_magic or header.key != key) {
+			return std::nullopt;
+		}
+
+		// the size comes from disk, a truncated or corrupted file is a miss rather than a huge allocation
+		std::error_code error;
+		const auto file_size = std::filesystem::file_size(path, error);
+		if (error or file_size < sizeof(header) or header.size != file_size - sizeof(header)) {
+			return std::nullopt;
+		}
+
+		auto binary = ProgramBinary{.format = header.format, .data = std::vector<std::byte>(header.size)};
+		in.read(reinterpret_cast<char*>(binary.data.data()), static_cast<std::streamsize>(header.size));
+		if (not in) {
+			return std::nullopt;
+		}
+		return binary;
+	}
+
+	// Best effort, a failure only costs a compilation at the next start
+	// Written aside and renamed over the cache file, a crash or another instance reading meanwhile never sees it partial
+	static void save_binary(const std::filesystem::path& path, std::uint64_t key, const ProgramBinary& binary) {
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+
+		auto temporary = path;
+		temporary += ".tmp";
+		{
+			std::ofstream out{temporary, std::ios::binary | std::ios::trunc};
+			const auto header = BinaryHeader{binary_magic, binary.format, key, binary.data.size()};
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(reinterpret_cast<const char*>(binary.data.data()), static_cast<std::streamsize>(binary.data.size()));
+			out.close();
+			if (not out) {
+				std::println("Unable to write the program binary {}", temporary.string());
+				std::filesystem::remove(temporary, error);
+				return;
+			}
+		}
+
+		std::filesystem::rename(temporary, path, error);
+		if (error) {
+			std::println("Unable to replace the program binary {}: {}", path.string(), error.message());
+			std::filesystem::remove(temporary, error);
+		}
 	}
 
 private:
 	std::vector<Shader> shaders;
+	std::vector<std::pair<ShaderType, std::string>> sources;
+	std::filesystem::path cache_directory;
+	bool from_cache = false;
 };
 
 struct DrawDescription {
@@ -345,11 +963,169 @@ struct DrawDescription {
 	GLsizei vertex_count;
 };
 
+// Layout read by glMultiDrawElementsIndirect from the GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+};
+
+// Offscreen render target with a RGBA8 color attachment, used when there is no window to render to
+class Framebuffer {
+public:
+	Framebuffer(int width, int height) : width{width}, height{height} {
+		glGenFramebuffers(1, &fbo);
+		glGenRenderbuffers(1, &color);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, color);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		CHECK_LAST_GL_CALL;
+
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+		CHECK_LAST_GL_CALL;
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			throw std::runtime_error{"Unable to create the offscreen framebuffer"};
+		}
+	}
+
+	~Framebuffer() {
+		if (fbo != 0) {
+			glDeleteFramebuffers(1, &fbo);
+			glDeleteRenderbuffers(1, &color);
+		}
+	}
+
+	Framebuffer(const Framebuffer&) = delete;
+	Framebuffer& operator=(const Framebuffer&) = delete;
+
+	Framebuffer(Framebuffer&& rhs) noexcept
+			: fbo{std::exchange(rhs.fbo, 0)}, color{std::exchange(rhs.color, 0)}, width{rhs.width}, height{rhs.height} {}
+
+	Framebuffer& operator=(Framebuffer&& rhs) noexcept {
+		std::swap(fbo, rhs.fbo);
+		std::swap(color, rhs.color);
+		std::swap(width, rhs.width);
+		std::swap(height, rhs.height);
+		return *this;
+	}
+
+	void bind() const {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		CHECK_LAST_GL_CALL;
+	}
+
+	// Synchronous, waits for the frame to be completed. `rgba` must hold width * height * 4 bytes
+	void read_pixels(std::span<std::uint8_t> rgba) const {
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+		CHECK_LAST_GL_CALL;
+	}
+
+	[[nodiscard]] std::size_t size_in_bytes() const {
+		return static_cast<std::size_t>(width) * static_cast<std::size_t>(height) * 4;
+	}
+
+private:
+	GLuint fbo{};
+	GLuint color{};
+	int width;
+	int height;
+};
+
+// GL_TIMESTAMP queries for `marks_per_frame` points of a frame, in a ring as deep as the frames the GPU can lag
+// behind. The results are read frames_in_flight - 1 frames later, when they are ready, so reading never stalls.
+class TimestampQueries {
+public:
+	static constexpr std::size_t frames_in_flight = 3;
+
+	explicit TimestampQueries(std::size_t marks_per_frame)
+			: marks_per_frame{marks_per_frame}, ids(frames_in_flight * marks_per_frame), results(marks_per_frame) {
+		glGenQueries(static_cast<GLsizei>(ids.size()), ids.data());
+		CHECK_LAST_GL_CALL;
+	}
+
+	~TimestampQueries() {
+		if (not ids.empty()) {
+			glDeleteQueries(static_cast<GLsizei>(ids.size()), ids.data());
+		}
+	}
+
+	TimestampQueries(const TimestampQueries&) = delete;
+	TimestampQueries& operator=(const TimestampQueries&) = delete;
+
+	// a moved from vector is empty, so only one of the two objects deletes the queries
+	TimestampQueries(TimestampQueries&&) noexcept = default;
+
+	void mark(std::size_t index) {
+		glQueryCounter(ids[current * marks_per_frame + index], GL_TIMESTAMP);
+		CHECK_LAST_GL_CALL;
+		issued[current] = true;
+	}
+
+	// Moves to the next frame and returns the timestamps, in nanoseconds, of the oldest frame in the ring. Returns
+	// nothing when that frame wasn't measured or the GPU hasn't reached it yet, it's dropped rather than waited for.
+	std::optional<std::span<const GLuint64>> end_frame() {
+		current = (current + 1) % frames_in_flight;
+		if (not std::exchange(issued[current], false)) {
+			return std::nullopt;
+		}
+
+		const auto frame_ids = std::span{ids}.subspan(current * marks_per_frame, marks_per_frame);
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(frame_ids.back(), GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available == GL_FALSE) {
+			return std::nullopt;
+		}
+
+		for (std::size_t i = 0; i != marks_per_frame; ++i) {
+			glGetQueryObjectui64v(frame_ids[i], GL_QUERY_RESULT, &results[i]);
+		}
+		CHECK_LAST_GL_CALL;
+
+		return results;
+	}
+
+private:
+	std::size_t marks_per_frame;
+	std::vector<GLuint> ids;
+	std::vector<GLuint64> results;
+	std::array<bool, frames_in_flight> issued{};
+	std::size_t current{};
+};
+
+// State shared by the windowed and the headless contexts. The driver may use as many threads as it likes for
+// PendingProgram, and alpha blending is on for the antialiased edges of the circles; opaque draws write alpha 1.
+void init_default_state() {
+	if (GLEW_KHR_parallel_shader_compile) {
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		CHECK_LAST_GL_CALL;
+	}
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	CHECK_LAST_GL_CALL;
+}
+
 void renderer_init() {
 	auto glewStatus = glewInit();
 	if (glewStatus != GLEW_OK) {
 		throw std::runtime_error("Unable to initialize OpenGL");
 	}
+	init_default_state();
+}
+
+// glewInit looks for a GLX display, which doesn't exist with an EGL context. The entry points are loaded without it.
+void renderer_init_headless() {
+	glewExperimental = GL_TRUE;
+	auto glewStatus = glewContextInit();
+	if (glewStatus != GLEW_OK) {
+		throw std::runtime_error("Unable to initialize OpenGL");
+	}
+	init_default_state();
 }
 
 void renderer_set_clear_color(const vis::vec4& color) {
@@ -364,13 +1140,24 @@ void renderer_clear() {
 
 void renderer_render(SDL_Window* window) {
 	SDL_GL_SwapWindow(window);
+	state_cache().end_frame();
 }
 
-void renderer_set_viewport(int x, int y, int width, int height) {
-	glViewport(x, y, width, height);
+// Blocks until the GPU has executed every queued command, used to time whole frames
+void renderer_finish() {
+	glFinish();
 	CHECK_LAST_GL_CALL;
 }
 
+// Multi draw indirect with a base instance per command, core since 4.3 and only an extension on the 4.1 context
+bool renderer_supports_multi_draw_indirect() {
+	return GLEW_ARB_multi_draw_indirect and GLEW_ARB_base_instance and glMultiDrawElementsIndirect != nullptr;
+}
+
+void renderer_set_viewport(int x, int y, int width, int height) {
+	state_cache().viewport(x, y, width, height);
+}
+
 std::string renderer_print_info() {
 	auto renderer = (const char*)glGetString(GL_RENDERER);
 	auto version = (const char*)glGetString(GL_VERSION);
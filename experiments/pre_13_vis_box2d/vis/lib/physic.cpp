@@ -6,7 +6,10 @@ module;
 export module vis:physic;
 
 import std;
+import :ecs;
 import :math;
+import :profile;
+import :tasks;
 
 export namespace vis::physics {
 
@@ -19,6 +22,29 @@ struct Rotation {
 	float cos_angle, sin_angle;
 };
 
+// Axis aligned box in world coordinates
+struct AABB {
+	vec2 lower;
+	vec2 upper;
+};
+
+// The bodies keep their entity in the Box2D user data, off by one so that a body without entity keeps nullptr
+void* to_user_data(vis::ecs::entity entity) {
+	return reinterpret_cast<void*>(static_cast<std::uintptr_t>(vis::ecs::to_integral(entity)) + 1);
+}
+
+vis::ecs::entity to_entity(void* user_data) {
+	if (user_data == nullptr) {
+		return vis::ecs::null;
+	}
+	return static_cast<vis::ecs::entity>(reinterpret_cast<std::uintptr_t>(user_data) - 1);
+}
+
+// The shapes carry the entity of their body, null once the shape is destroyed
+vis::ecs::entity to_entity(b2ShapeId shape) {
+	return b2Shape_IsValid(shape) ? to_entity(b2Shape_GetUserData(shape)) : vis::ecs::null;
+}
+
 enum class BodyType {
 	fixed = 0,
 	kinematic = 1,
@@ -53,6 +79,29 @@ public:
 		return *this;
 	}
 
+	// A body allowed to sleep is taken out of the solver after resting for a while, until something touches it
+	RigidBodyDef& set_enable_sleep(bool enable_sleep) {
+		def.enableSleep = enable_sleep;
+		return *this;
+	}
+
+	RigidBodyDef& set_is_awake(bool is_awake) {
+		def.isAwake = is_awake;
+		return *this;
+	}
+
+	// Speed in m/s under which the body counts as resting
+	RigidBodyDef& set_sleep_threshold(float sleep_threshold) {
+		def.sleepThreshold = sleep_threshold;
+		return *this;
+	}
+
+	// Entity owning the body, handed back by the world queries and events
+	RigidBodyDef& set_entity(vis::ecs::entity entity) {
+		def.userData = to_user_data(entity);
+		return *this;
+	}
+
 	explicit operator const b2BodyDef*() const {
 		return &def;
 	}
@@ -68,23 +117,212 @@ struct Transformation {
 
 	mat4 get_model() const {
 		auto model = vis::ext::identity<vis::mat4>();
-		model[0][0] = rotation.cos_angle;
-		model[1][0] = -rotation.sin_angle;
-		model[0][1] = rotation.sin_angle;
-		model[1][1] = rotation.cos_angle;
+		model[0][0] = rotation.cos_angle * scale.x;
+		model[1][0] = -rotation.sin_angle * scale.y;
+		model[0][1] = rotation.sin_angle * scale.x;
+		model[1][1] = rotation.cos_angle * scale.y;
 		model[3][0] = position.x;
 		model[3][1] = position.y;
 		return model;
 	}
 };
 
+// State of a body before and after the last fixed step. Rendering blends the two with FixedStepClock::alpha, so the
+// motion stays smooth at any display rate, a step behind the simulation
+struct InterpolatedTransformation {
+	Transformation previous;
+	Transformation current;
+};
+
+// The rotation is blended linearly and normalized again, close enough for the small angles of one step
+Transformation interpolate(const Transformation& previous, const Transformation& current, float alpha) {
+	const auto cos_angle = std::lerp(previous.rotation.cos_angle, current.rotation.cos_angle, alpha);
+	const auto sin_angle = std::lerp(previous.rotation.sin_angle, current.rotation.sin_angle, alpha);
+	const auto length = std::hypot(cos_angle, sin_angle);
+	return Transformation{
+			.position = previous.position + (current.position - previous.position) * alpha,
+			.scale = current.scale,
+			.rotation = length > 0.0f ? Rotation{cos_angle / length, sin_angle / length} : current.rotation,
+	};
+}
+
+// Turns the variable frame time into a number of fixed steps. What is left over is exposed as alpha, the fraction of
+// a step elapsed since the last one. A frame never runs more than max_steps, the rest is dropped so a slow frame
+// doesn't make the next ones slower.
+class FixedStepClock {
+public:
+	explicit FixedStepClock(float step, int max_steps = 8) : step{step}, max_steps{max_steps} {}
+
+	// Steps to run this frame
+	[[nodiscard]] int advance(float dt) {
+		accumulated += dt;
+		const auto steps = std::min(static_cast<int>(accumulated / step), max_steps);
+		accumulated -= static_cast<float>(steps) * step;
+		if (steps == max_steps) {
+			accumulated = std::min(accumulated, step);
+		}
+		return steps;
+	}
+
+	[[nodiscard]] float alpha() const {
+		return std::clamp(accumulated / step, 0.0f, 1.0f);
+	}
+
+	[[nodiscard]] float time_step() const {
+		return step;
+	}
+
+private:
+	float step;
+	int max_steps;
+	float accumulated{};
+};
+
+// Body moved by the last step, a view over b2BodyMoveEvent so a span of them costs no copy
+class BodyMoveEvent {
+public:
+	// null for the bodies created without RigidBodyDef::set_entity
+	[[nodiscard]] vis::ecs::entity entity() const {
+		return to_entity(event.userData);
+	}
+
+	[[nodiscard]] vec2 position() const {
+		return vec2{event.transform.p.x, event.transform.p.y};
+	}
+
+	[[nodiscard]] Rotation rotation() const {
+		return Rotation{event.transform.q.c, event.transform.q.s};
+	}
+
+	[[nodiscard]] bool fell_asleep() const {
+		return event.fellAsleep;
+	}
+
+private:
+	b2BodyMoveEvent event;
+};
+
+static_assert(sizeof(BodyMoveEvent) == sizeof(b2BodyMoveEvent) and std::is_standard_layout_v<BodyMoveEvent>);
+
+// Two shapes started touching during the last step, a view over b2ContactBeginTouchEvent
+class ContactBeginEvent {
+public:
+	[[nodiscard]] vis::ecs::entity entity_a() const {
+		return to_entity(event.shapeIdA);
+	}
+
+	[[nodiscard]] vis::ecs::entity entity_b() const {
+		return to_entity(event.shapeIdB);
+	}
+
+private:
+	b2ContactBeginTouchEvent event;
+};
+
+// Two shapes stopped touching during the last step, a view over b2ContactEndTouchEvent. A shape destroyed since
+// gives a null entity
+class ContactEndEvent {
+public:
+	[[nodiscard]] vis::ecs::entity entity_a() const {
+		return to_entity(event.shapeIdA);
+	}
+
+	[[nodiscard]] vis::ecs::entity entity_b() const {
+		return to_entity(event.shapeIdB);
+	}
+
+private:
+	b2ContactEndTouchEvent event;
+};
+
+// Two shapes hit each other faster than the hit threshold of the world, a view over b2ContactHitEvent
+class ContactHitEvent {
+public:
+	[[nodiscard]] vis::ecs::entity entity_a() const {
+		return to_entity(event.shapeIdA);
+	}
+
+	[[nodiscard]] vis::ecs::entity entity_b() const {
+		return to_entity(event.shapeIdB);
+	}
+
+	[[nodiscard]] vec2 point() const {
+		return vec2{event.point.x, event.point.y};
+	}
+
+	// from shape A to shape B
+	[[nodiscard]] vec2 normal() const {
+		return vec2{event.normal.x, event.normal.y};
+	}
+
+	// m/s, always positive
+	[[nodiscard]] float approach_speed() const {
+		return event.approachSpeed;
+	}
+
+private:
+	b2ContactHitEvent event;
+};
+
+static_assert(sizeof(ContactBeginEvent) == sizeof(b2ContactBeginTouchEvent) and
+							std::is_standard_layout_v<ContactBeginEvent>);
+static_assert(sizeof(ContactEndEvent) == sizeof(b2ContactEndTouchEvent) and std::is_standard_layout_v<ContactEndEvent>);
+static_assert(sizeof(ContactHitEvent) == sizeof(b2ContactHitEvent) and std::is_standard_layout_v<ContactHitEvent>);
+
+// Owns a body and through it the body's shapes, destroyed with it. Box2D isn't thread safe: a body stepped on another
+// thread must be handed over to SimulationThread::destroy_body instead of going out of scope. Destroying the world
+// first is fine, the body is gone already
 class RigidBody {
 public:
 	friend class World;
 
+	RigidBody(RigidBody&& rhs) noexcept : id{std::exchange(rhs.id, b2_nullBodyId)} {}
+	RigidBody& operator=(RigidBody&& rhs) noexcept {
+		if (this != &rhs) {
+			destroy();
+			id = std::exchange(rhs.id, b2_nullBodyId);
+		}
+		return *this;
+	}
+
+	RigidBody(const RigidBody&) = delete;
+	RigidBody& operator=(const RigidBody&) = delete;
+
+	~RigidBody() {
+		destroy();
+	}
+
 	RigidBody& create_shape(const ShapeDef& shape, const Polygon& polygon);
 	RigidBody& create_shape(const ShapeDef& shape, const Circle& circle);
 
+	// Replaces the geometry of the circle shapes of the body
+	void set_circle(const Circle& circle);
+
+	// Moved from bodies are empty
+	[[nodiscard]] bool is_empty() const {
+		return B2_IS_NULL(id);
+	}
+
+	[[nodiscard]] vis::ecs::entity entity() const {
+		return to_entity(b2Body_GetUserData(id));
+	}
+
+	[[nodiscard]] bool is_awake() const {
+		return b2Body_IsAwake(id);
+	}
+
+	void set_awake(bool awake) {
+		b2Body_SetAwake(id, awake);
+	}
+
+	// Out of the simulation, no contact, no event, until reset
+	void disable() {
+		b2Body_Disable(id);
+	}
+
+	// Back in the simulation as a new body made from `def`, its shapes kept
+	void reset(const RigidBodyDef& def);
+
 	Transformation get_transform() const {
 		Transformation res;
 		const auto& [p, q] = b2Body_GetTransform(id);
@@ -96,9 +334,22 @@ public:
 private:
 	RigidBody(const World& world, const RigidBodyDef& def);
 
+	// The first 8 shapes, plenty for the bodies made here
+	template <typename Fn> void for_each_shape(Fn&& fn) const;
+
+	void destroy() {
+		if (b2Body_IsValid(id)) {
+			b2DestroyBody(id);
+		}
+		id = b2_nullBodyId;
+	}
+
 	::b2BodyId id;
 };
 
+// Box2D sizes its per worker data for at most this many workers
+constexpr std::uint32_t max_workers = 64;
+
 class WorldDef {
 public:
 	WorldDef() : def{::b2DefaultWorldDef()} {
@@ -109,6 +360,34 @@ public:
 		def.gravity = b2Vec2(g.x, g.y);
 	}
 
+	// Off, no body ever sleeps whatever its own setting
+	void set_enable_sleep(bool enable_sleep) {
+		def.enableSleep = enable_sleep;
+	}
+
+	// Approach speed in m/s above which a contact is reported as a hit
+	void set_hit_event_threshold(float threshold) {
+		def.hitEventThreshold = threshold;
+	}
+
+	// Runs the solver stages of the step on the workers of `tasks`, which must outlive the world. Every worker index
+	// of the pool reaches Box2D, so it can't have more than max_workers
+	void set_task_system(vis::tasks::TaskSystem& tasks) {
+		if (tasks.worker_count() > max_workers) {
+			throw std::runtime_error{
+					std::format("A world can't use {} workers, {} at most", tasks.worker_count(), max_workers)};
+		}
+		def.workerCount = static_cast<int>(tasks.worker_count());
+		def.enqueueTask = [](b2TaskCallback* task, std::int32_t item_count, std::int32_t min_range, void* task_context,
+												 void* user_context) -> void* {
+			return static_cast<vis::tasks::TaskSystem*>(user_context)->enqueue(task, item_count, min_range, task_context);
+		};
+		def.finishTask = [](void* user_task, void* user_context) {
+			static_cast<vis::tasks::TaskSystem*>(user_context)->wait(static_cast<vis::tasks::Task*>(user_task));
+		};
+		def.userTaskContext = &tasks;
+	}
+
 	explicit operator const b2WorldDef*() const {
 		return &def;
 	}
@@ -142,13 +421,71 @@ public:
 	}
 
 	void step(float time_step, int sub_step_count) const {
+		const auto scope = vis::profile::Scope{"World::step"};
 		b2World_Step(id, time_step, sub_step_count);
 	}
 
+	void set_enable_sleep(bool enable_sleep) const {
+		b2World_EnableSleeping(id, enable_sleep);
+	}
+
 	RigidBody create_body(const RigidBodyDef& def) const {
 		return RigidBody{*this, def};
 	}
 
+	// One body per definition appended to `bodies`, in the same order. Reusing the vector keeps the spawns from
+	// allocating once it has grown
+	void create_bodies(std::span<const RigidBodyDef> defs, std::vector<RigidBody>& bodies) const {
+		bodies.reserve(bodies.size() + defs.size());
+		for (const auto& def : defs) {
+			bodies.push_back(RigidBody{*this, def});
+		}
+	}
+
+	// Contacts of the last step between shapes created with contact events on, the default. Valid until the next step
+	[[nodiscard]] std::span<const ContactBeginEvent> contact_begin_events() const {
+		const auto events = b2World_GetContactEvents(id);
+		return {reinterpret_cast<const ContactBeginEvent*>(events.beginEvents),
+						static_cast<std::size_t>(events.beginCount)};
+	}
+
+	[[nodiscard]] std::span<const ContactEndEvent> contact_end_events() const {
+		const auto events = b2World_GetContactEvents(id);
+		return {reinterpret_cast<const ContactEndEvent*>(events.endEvents), static_cast<std::size_t>(events.endCount)};
+	}
+
+	// Only between shapes with hit events on, see ShapeDef::set_enable_hit_events. A SimulationThread hands them over in
+	// WorldSnapshot::hits
+	[[nodiscard]] std::span<const ContactHitEvent> contact_hit_events() const {
+		const auto events = b2World_GetContactEvents(id);
+		return {reinterpret_cast<const ContactHitEvent*>(events.hitEvents), static_cast<std::size_t>(events.hitCount)};
+	}
+
+	// Bodies moved by the last step, fixed and sleeping bodies never show up. Valid until the next step
+	[[nodiscard]] std::span<const BodyMoveEvent> body_move_events() const {
+		const auto events = b2World_GetBodyEvents(id);
+		return {reinterpret_cast<const BodyMoveEvent*>(events.moveEvents), static_cast<std::size_t>(events.moveCount)};
+	}
+
+	// Calls fn(entity) for every shape whose broadphase box overlaps `aabb`, the broadphase boxes are a little larger
+	// than the shapes. A body with several shapes is reported once per shape, bodies without entity aren't reported.
+	template <typename Fn> void overlap_aabb(const AABB& aabb, Fn&& fn) const {
+		const auto box = b2AABB{
+				.lowerBound = b2Vec2(aabb.lower.x, aabb.lower.y),
+				.upperBound = b2Vec2(aabb.upper.x, aabb.upper.y),
+		};
+		b2World_OverlapAABB(
+				id, box, b2DefaultQueryFilter(),
+				[](b2ShapeId shape, void* context) {
+					const auto entity = to_entity(b2Body_GetUserData(b2Shape_GetBody(shape)));
+					if (entity != vis::ecs::null) {
+						(*static_cast<std::remove_reference_t<Fn>*>(context))(entity);
+					}
+					return true;
+				},
+				&fn);
+	}
+
 	explicit operator b2WorldId() const {
 		return id;
 	}
@@ -198,6 +535,17 @@ public:
 		return *this;
 	}
 
+	ShapeDef& set_enable_contact_events(bool enable) {
+		def.enableContactEvents = enable;
+		return *this;
+	}
+
+	// Off by default, a hit is a contact faster than WorldDef::set_hit_event_threshold
+	ShapeDef& set_enable_hit_events(bool enable) {
+		def.enableHitEvents = enable;
+		return *this;
+	}
+
 	explicit operator const b2ShapeDef*() const {
 		return &def;
 	}
@@ -220,14 +568,393 @@ struct Circle {
 	}
 };
 
+// The shape gets the entity of the body, for the contact events
 RigidBody& RigidBody::create_shape(const ShapeDef& shape, const Polygon& polygon) {
-	b2CreatePolygonShape(id, static_cast<const b2ShapeDef*>(shape), static_cast<const b2Polygon*>(polygon));
+	auto def = *static_cast<const b2ShapeDef*>(shape);
+	def.userData = b2Body_GetUserData(id);
+	b2CreatePolygonShape(id, &def, static_cast<const b2Polygon*>(polygon));
 	return *this;
 }
 
 RigidBody& RigidBody::create_shape(const ShapeDef& shape, const Circle& circle) {
-	b2CreateCircleShape(id, static_cast<const b2ShapeDef*>(shape), static_cast<const b2Circle*>(circle));
+	auto def = *static_cast<const b2ShapeDef*>(shape);
+	def.userData = b2Body_GetUserData(id);
+	b2CreateCircleShape(id, &def, static_cast<const b2Circle*>(circle));
 	return *this;
 }
 
+template <typename Fn> void RigidBody::for_each_shape(Fn&& fn) const {
+	std::array<b2ShapeId, 8> shapes;
+	const auto count = b2Body_GetShapes(id, shapes.data(), static_cast<int>(shapes.size()));
+	for (const auto shape : std::span{shapes}.first(static_cast<std::size_t>(count))) {
+		fn(shape);
+	}
+}
+
+void RigidBody::set_circle(const Circle& circle) {
+	for_each_shape([&](b2ShapeId shape) {
+		if (b2Shape_GetType(shape) == b2_circleShape) {
+			b2Shape_SetCircle(shape, static_cast<const b2Circle*>(circle));
+		}
+	});
+}
+
+void RigidBody::reset(const RigidBodyDef& rigid_body_def) {
+	const auto& def = *static_cast<const b2BodyDef*>(rigid_body_def);
+	b2Body_SetType(id, def.type);
+	b2Body_SetTransform(id, def.position, def.rotation);
+	b2Body_SetLinearVelocity(id, def.linearVelocity);
+	b2Body_SetAngularVelocity(id, def.angularVelocity);
+	b2Body_SetBullet(id, def.isBullet);
+	b2Body_SetUserData(id, def.userData);
+	for_each_shape([&](b2ShapeId shape) { b2Shape_SetUserData(shape, def.userData); });
+	b2Body_EnableSleep(id, def.enableSleep);
+	b2Body_SetSleepThreshold(id, def.sleepThreshold);
+	b2Body_Enable(id);
+	b2Body_SetAwake(id, def.isAwake);
+}
+
+// Disabled bodies of despawned entities, handed out again to the next spawns so a scene with a steady churn stops
+// creating and destroying bodies. A recycled body keeps its shapes, so a pool only holds bodies of one kind. Past the
+// capacity the released bodies are destroyed
+class BodyPool {
+public:
+	explicit BodyPool(std::size_t capacity) : capacity{capacity} {
+		bodies.reserve(capacity);
+	}
+
+	void release(RigidBody&& body) {
+		if (body.is_empty()) {
+			return;
+		}
+		if (bodies.size() == capacity) {
+			auto destroyed = std::move(body);
+			return;
+		}
+
+		body.disable();
+		bodies.push_back(std::move(body));
+	}
+
+	[[nodiscard]] std::optional<RigidBody> acquire(const RigidBodyDef& def) {
+		if (bodies.empty()) {
+			return std::nullopt;
+		}
+
+		auto body = std::move(bodies.back());
+		bodies.pop_back();
+		body.reset(def);
+		return body;
+	}
+
+	[[nodiscard]] std::size_t size() const {
+		return bodies.size();
+	}
+
+private:
+	std::size_t capacity;
+	std::vector<RigidBody> bodies;
+};
+
+// Pose of a body before and after the last step, whatever the number of steps since the previous snapshot. A body
+// that did not move in the last step has the same pose in both
+struct BodyState {
+	vis::ecs::entity entity;
+	vec2 previous_position{};
+	Rotation previous_rotation{1.0f, 0.0f};
+	vec2 position{};
+	Rotation rotation{1.0f, 0.0f};
+	bool awake = true;
+};
+
+// Tag of the entities whose body is awake, the systems working on moving bodies view it to skip the resting ones
+struct Awake {};
+
+// Contact events counted since the world was created, totals so that a skipped snapshot loses nothing
+struct ContactTotals {
+	std::uint64_t begun{};
+	std::uint64_t ended{};
+	std::uint64_t hits{};
+};
+
+// A ContactHitEvent copied out of its step, an entity is null for a shape created without one
+struct ContactHit {
+	vis::ecs::entity entity_a;
+	vis::ecs::entity entity_b;
+	vec2 point{};
+	float approach_speed{}; // m/s
+	std::uint64_t step{}; // the step that raised it
+};
+
+// What the simulation thread hands over to the render loop
+struct WorldSnapshot {
+	std::uint64_t step{}; // steps run so far, 0 before the first one
+	std::chrono::steady_clock::time_point time{}; // when the last step was due
+	// the awake bodies with an entity, and those that fell asleep since the snapshot taken before this one
+	std::vector<BodyState> bodies;
+	std::vector<vis::ecs::entity> visible; // bodies overlapping the camera, sorted and unique
+	ContactTotals contacts;
+	// the hits of the steps after the snapshot taken before this one. A hit may come again in the next snapshot when
+	// the reader took one in between, skip those not newer than the step of the last snapshot handled
+	std::vector<ContactHit> hits;
+};
+
+// Owns a world and steps it at a fixed rate on its own thread, publishing a WorldSnapshot after the steps. The render
+// loop reads the latest snapshot without ever waiting on a step. The world itself is only reachable through with_world,
+// which waits for the step in progress, so keep it for the rare changes like spawning a body. The bodies are released
+// without waiting, they are destroyed or recycled after the next step.
+class SimulationThread {
+public:
+	SimulationThread(World world, float time_step, int sub_step_count, const AABB& camera, std::size_t pool_capacity = 0)
+			: world{std::move(world)}, clock{time_step}, step_duration{time_step}, sub_step_count{sub_step_count},
+				camera{camera}, pool{pool_capacity}, thread{[this](std::stop_token stop) { run(stop); }} {}
+
+	SimulationThread(const SimulationThread&) = delete;
+	SimulationThread& operator=(const SimulationThread&) = delete;
+
+	// Runs fn(world) in between two steps
+	template <typename Fn> decltype(auto) with_world(Fn&& fn) {
+		const std::scoped_lock lock{world_mutex};
+		return std::forward<Fn>(fn)(world);
+	}
+
+	// One body per definition into `bodies`, cleared first, taken from the recycled bodies first. A new body has no
+	// shape yet while a recycled one still has those of its previous life, init(body, index, recycled) sets them up
+	template <typename Fn>
+	void create_bodies(std::span<const RigidBodyDef> defs, std::vector<RigidBody>& bodies, Fn&& init) {
+		const std::scoped_lock lock{world_mutex};
+		bodies.clear();
+		bodies.reserve(defs.size());
+		for (const auto& def : defs.first(std::min(defs.size(), pool.size()))) {
+			bodies.push_back(*pool.acquire(def));
+			init(bodies.back(), bodies.size() - 1, true);
+		}
+
+		const auto recycled = bodies.size();
+		world.create_bodies(defs.subspan(recycled), bodies);
+		for (auto i = recycled; i != bodies.size(); ++i) {
+			init(bodies[i], i, false);
+		}
+	}
+
+	void destroy_body(RigidBody&& body) {
+		if (body.is_empty()) {
+			return;
+		}
+		const std::scoped_lock lock{release_mutex};
+		pending_destroyed.push_back(std::move(body));
+	}
+
+	// Into the pool for create_bodies, the bodies must be of the kind it creates
+	void recycle_bodies(std::span<RigidBody> bodies) {
+		const std::scoped_lock lock{release_mutex};
+		std::ranges::move(bodies, std::back_inserter(pending_recycled));
+	}
+
+	void set_camera(const AABB& aabb) {
+		const std::scoped_lock lock{world_mutex};
+		camera = aabb;
+	}
+
+	// Only one thread may read the snapshots, the reference stays valid until its next call. The reader takes in every
+	// snapshot it gets, the next ones leave out the bodies it already saw fall asleep
+	[[nodiscard]] const WorldSnapshot& latest() {
+		const auto& snapshot = snapshots.front();
+		taken_step.store(snapshot.step, std::memory_order_release);
+		return snapshot;
+	}
+
+	[[nodiscard]] float time_step() const {
+		return step_duration;
+	}
+
+	// Fraction of a step elapsed since the snapshot, to interpolate the bodies up to now
+	[[nodiscard]] float alpha(const WorldSnapshot& snapshot) const {
+		const auto elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - snapshot.time).count();
+		return std::clamp(elapsed / step_duration, 0.0f, 1.0f);
+	}
+
+private:
+	void run(std::stop_token stop) {
+		auto previous = std::chrono::steady_clock::now();
+		while (not stop.stop_requested()) {
+			const auto now = std::chrono::steady_clock::now();
+			const auto steps = clock.advance(std::chrono::duration<float>(now - previous).count());
+			previous = now;
+
+			if (steps != 0) {
+				const auto late = std::chrono::duration<float>(clock.alpha() * step_duration);
+				step(steps, now - std::chrono::duration_cast<std::chrono::steady_clock::duration>(late));
+			}
+
+			const auto until_next = std::chrono::duration<float>((1.0f - clock.alpha()) * step_duration);
+			std::this_thread::sleep_until(now + std::chrono::ceil<std::chrono::steady_clock::duration>(until_next));
+		}
+	}
+
+	void step(int steps, std::chrono::steady_clock::time_point time) {
+		const auto scope = vis::profile::Scope{"SimulationThread::step"};
+		auto& snapshot = snapshots.back();
+		{
+			const std::scoped_lock lock{world_mutex};
+			for (int i = 0; i != steps; ++i) {
+				// the despawned bodies must not touch anything in the step
+				release_bodies();
+				world.step(step_duration, sub_step_count);
+				++step_count;
+				record_moved_bodies();
+				contacts.begun += world.contact_begin_events().size();
+				contacts.ended += world.contact_end_events().size();
+				contacts.hits += world.contact_hit_events().size();
+				record_hits();
+			}
+
+			snapshot.visible.clear();
+			world.overlap_aabb(camera, [&](vis::ecs::entity entity) { snapshot.visible.push_back(entity); });
+		}
+
+		// a body with several shapes comes once per shape
+		std::ranges::sort(snapshot.visible);
+		const auto duplicates = std::ranges::unique(snapshot.visible);
+		snapshot.visible.erase(duplicates.begin(), duplicates.end());
+
+		// the reader may skip snapshots, a body stays in until the reader took a snapshot made after it fell asleep
+		const auto taken = taken_step.load(std::memory_order_acquire);
+		snapshot.bodies.clear();
+		for (const auto& body : bodies) {
+			if (body.state.awake or body.fell_asleep_at > taken) {
+				auto& state = snapshot.bodies.emplace_back(body.state);
+				if (body.moved_at != step_count) {
+					state.previous_position = state.position;
+					state.previous_rotation = state.rotation;
+				}
+			}
+		}
+		// same for the hits, kept until the reader took a snapshot made after them
+		std::erase_if(hits, [&](const ContactHit& hit) { return hit.step <= taken; });
+		snapshot.hits.assign(hits.begin(), hits.end());
+		snapshot.step = step_count;
+		snapshot.contacts = contacts;
+		snapshot.time = time;
+		snapshots.publish();
+	}
+
+	// The move events only list the bodies moved by the last step, a body missing from them is asleep since its last
+	// event, the one telling it fell asleep
+	void record_moved_bodies() {
+		for (const auto& event : world.body_move_events()) {
+			const auto entity = event.entity();
+			if (entity == vis::ecs::null) {
+				continue;
+			}
+
+			const auto index = vis::ecs::to_entity(entity);
+			if (index >= body_slots.size()) {
+				body_slots.resize(index + 1, no_slot);
+			}
+			auto& slot = body_slots[index];
+			const auto tracked = slot != no_slot;
+			if (not tracked) {
+				slot = static_cast<std::uint32_t>(bodies.size());
+				bodies.emplace_back();
+			}
+
+			// the entity may be a new version of a despawned one, whose body isn't released yet. A body seen for the
+			// first time has no pose before the step, it starts where the step left it
+			auto& body = bodies[slot];
+			const auto known = tracked and body.state.entity == entity;
+			body.state.entity = entity;
+			body.state.previous_position = known ? body.state.position : event.position();
+			body.state.previous_rotation = known ? body.state.rotation : event.rotation();
+			body.state.position = event.position();
+			body.state.rotation = event.rotation();
+			body.state.awake = not event.fell_asleep();
+			body.fell_asleep_at = body.state.awake ? 0 : step_count;
+			body.moved_at = step_count;
+		}
+	}
+
+	// The events of a step are gone with the next one, the hits are copied out with their entities
+	void record_hits() {
+		for (const auto& event : world.contact_hit_events()) {
+			hits.push_back(ContactHit{
+					.entity_a = event.entity_a(),
+					.entity_b = event.entity_b(),
+					.point = event.point(),
+					.approach_speed = event.approach_speed(),
+					.step = step_count,
+			});
+		}
+	}
+
+	// Takes the bodies released since the previous step, the vectors swapped back and forth keep their capacity
+	void release_bodies() {
+		{
+			const std::scoped_lock lock{release_mutex};
+			std::swap(pending_destroyed, destroyed);
+			std::swap(pending_recycled, recycled);
+		}
+
+		for (auto& body : destroyed) {
+			forget(body.entity());
+		}
+		destroyed.clear();
+
+		for (auto& body : recycled) {
+			if (not body.is_empty()) {
+				forget(body.entity());
+				pool.release(std::move(body));
+			}
+		}
+		recycled.clear();
+	}
+
+	void forget(vis::ecs::entity entity) {
+		const auto index = vis::ecs::to_entity(entity);
+		if (index >= body_slots.size() or body_slots[index] == no_slot or
+				bodies[body_slots[index]].state.entity != entity) {
+			return;
+		}
+
+		const auto slot = body_slots[index];
+		bodies[slot] = bodies.back();
+		body_slots[vis::ecs::to_entity(bodies[slot].state.entity)] = slot;
+		bodies.pop_back();
+		body_slots[index] = no_slot;
+	}
+
+private:
+	World world;
+	std::mutex world_mutex;
+	FixedStepClock clock;
+	const float step_duration;
+	const int sub_step_count;
+	AABB camera; // guarded by world_mutex
+	std::uint64_t step_count{};
+	ContactTotals contacts;
+
+	struct TrackedBody {
+		BodyState state;
+		std::uint64_t fell_asleep_at{}; // step, 0 while awake
+		std::uint64_t moved_at{}; // last step with a move event, the pose before it is stale after that
+	};
+
+	static constexpr auto no_slot = std::numeric_limits<std::uint32_t>::max();
+	std::vector<TrackedBody> bodies;
+	std::vector<std::uint32_t> body_slots; // index in bodies by entity index
+	std::vector<ContactHit> hits; // not yet in a snapshot taken by the reader
+	vis::tasks::TripleBuffer<WorldSnapshot> snapshots;
+	std::atomic<std::uint64_t> taken_step{}; // of the last snapshot taken by the reader
+
+	BodyPool pool;
+	std::mutex release_mutex;
+	std::vector<RigidBody> pending_destroyed; // guarded by release_mutex
+	std::vector<RigidBody> pending_recycled; // guarded by release_mutex
+	std::vector<RigidBody> destroyed;
+	std::vector<RigidBody> recycled;
+
+	// last, so it is joined before anything it uses goes away
+	std::jthread thread;
+};
+
 } // namespace vis::physics
\ No newline at end of file
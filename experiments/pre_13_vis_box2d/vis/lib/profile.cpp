@@ -0,0 +1,206 @@
+module;
+
+#include <SDL3/SDL_timer.h>
+
+export module vis:profile;
+
+import std;
+
+namespace vis::profile {
+
+struct Event {
+	const char* name;
+	std::uint64_t begin;
+	std::uint64_t end;
+};
+
+// Single writer ring, the owning thread pushes while any thread may read it. Every slot is a seqlock: its sequence is
+// odd while the writer fills it, and tells which push it holds once done, so a reader skips the slots being rewritten
+// instead of reading them torn.
+class ThreadBuffer {
+public:
+	static constexpr std::size_t capacity = 1 << 16;
+
+	explicit ThreadBuffer(std::uint32_t thread_id) : thread_id{thread_id}, slots{std::make_unique<Slot[]>(capacity)} {}
+
+	void push(const Event& event) {
+		const auto index = head.load(std::memory_order_relaxed);
+		auto& slot = slots[index % capacity];
+		slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.name.store(event.name, std::memory_order_relaxed);
+		slot.begin.store(event.begin, std::memory_order_relaxed);
+		slot.end.store(event.end, std::memory_order_relaxed);
+		slot.sequence.store(2 * index + 2, std::memory_order_release);
+		head.store(index + 1, std::memory_order_release);
+	}
+
+	template <typename Fn> void for_each(Fn&& fn) const {
+		const auto end = head.load(std::memory_order_acquire);
+		const auto begin = end > capacity ? end - capacity : 0;
+		for (auto i = begin; i != end; ++i) {
+			const auto& slot = slots[i % capacity];
+			const auto sequence = slot.sequence.load(std::memory_order_acquire);
+			if (sequence != 2 * i + 2) {
+				continue;
+			}
+
+			const auto event = Event{
+					slot.name.load(std::memory_order_relaxed),
+					slot.begin.load(std::memory_order_relaxed),
+					slot.end.load(std::memory_order_relaxed),
+			};
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+				fn(event);
+			}
+		}
+	}
+
+	const std::uint32_t thread_id;
+
+private:
+	struct Slot {
+		std::atomic<std::uint64_t> sequence{0};
+		std::atomic<const char*> name{nullptr};
+		std::atomic<std::uint64_t> begin{0};
+		std::atomic<std::uint64_t> end{0};
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	std::atomic<std::uint64_t> head{0};
+};
+
+// The buffers are never released, so the events of the threads that already exited can still be dumped
+struct Registry {
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	std::atomic<bool> enabled{true};
+
+	// written by the main loop, read by whichever thread writes a trace
+	static constexpr std::size_t max_frames = 1024;
+	std::array<std::atomic<std::uint64_t>, max_frames> frame_begins{};
+	std::atomic<std::uint64_t> frame_count{};
+};
+
+Registry& registry() {
+	static Registry instance;
+	return instance;
+}
+
+ThreadBuffer& thread_buffer() {
+	thread_local ThreadBuffer* buffer = [] {
+		auto& reg = registry();
+		const std::scoped_lock lock{reg.mutex};
+		const auto thread_id = static_cast<std::uint32_t>(reg.buffers.size());
+		return reg.buffers.emplace_back(std::make_unique<ThreadBuffer>(thread_id)).get();
+	}();
+	return *buffer;
+}
+
+std::uint64_t now() {
+	return SDL_GetPerformanceCounter();
+}
+
+void write_json_string(std::ostream& out, std::string_view value) {
+	out << '"';
+	for (const auto c : value) {
+		switch (c) {
+		case '"':
+			out << "\\\"";
+			break;
+		case '\\':
+			out << "\\\\";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				out << std::format("\\u{:04x}", static_cast<unsigned>(static_cast<unsigned char>(c)));
+			} else {
+				out << c;
+			}
+		}
+	}
+	out << '"';
+}
+
+} // namespace vis::profile
+
+export namespace vis::profile {
+
+void set_enabled(bool enabled) {
+	registry().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+[[nodiscard]] bool is_enabled() {
+	return registry().enabled.load(std::memory_order_relaxed);
+}
+
+// Times the enclosing scope, scopes nest. `name` must outlive the profiler, pass a string literal:
+//     const auto scope = vis::profile::Scope{"World::step"};
+class Scope {
+public:
+	explicit Scope(const char* name) : name{is_enabled() ? name : nullptr}, begin{this->name ? now() : 0} {}
+
+	~Scope() {
+		if (name) {
+			thread_buffer().push(Event{name, begin, now()});
+		}
+	}
+
+	Scope(const Scope&) = delete;
+	Scope& operator=(const Scope&) = delete;
+
+private:
+	const char* name;
+	std::uint64_t begin;
+};
+
+// Marks the beginning of a frame, called once per frame from the main loop
+void begin_frame() {
+	auto& reg = registry();
+	const auto frame = reg.frame_count.load(std::memory_order_relaxed);
+	reg.frame_begins[frame % Registry::max_frames].store(now(), std::memory_order_relaxed);
+	reg.frame_count.store(frame + 1, std::memory_order_release);
+}
+
+// Writes the events of every thread recorded in the last `frame_count` frames as Chrome trace_event JSON, which can
+// be opened in Perfetto or chrome://tracing. Doesn't throw, returns false when the file can't be written
+bool write_chrome_trace(const std::filesystem::path& path, std::size_t frame_count) {
+	auto& reg = registry();
+	const auto frames = reg.frame_count.load(std::memory_order_acquire);
+	frame_count = std::min({frame_count, Registry::max_frames, static_cast<std::size_t>(frames)});
+	const auto since = frame_count == 0 ? 0
+																			: reg.frame_begins[(frames - frame_count) % Registry::max_frames].load(
+																						std::memory_order_relaxed);
+	const auto ticks_per_us = static_cast<double>(SDL_GetPerformanceFrequency()) / 1'000'000.0;
+
+	std::ofstream out{path};
+	if (not out) {
+		std::println("Unable to write the trace to {}", path.string());
+		return false;
+	}
+
+	out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+	bool first = true;
+	const std::scoped_lock lock{reg.mutex};
+	for (const auto& buffer : reg.buffers) {
+		buffer->for_each([&](const Event& event) {
+			if (event.begin < since) {
+				return;
+			}
+
+			out << (first ? R"({"name":)" : R"(,{"name":)");
+			write_json_string(out, event.name);
+			out << std::format(R"(,"ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f}}})", buffer->thread_id,
+												 static_cast<double>(event.begin - since) / ticks_per_us,
+												 static_cast<double>(event.end - event.begin) / ticks_per_us);
+			first = false;
+		});
+	}
+	out << "]}\n";
+
+	std::println("Trace of the last {} frames written to {}", frame_count, path.string());
+	return true;
+}
+
+} // namespace vis::profile
@@ -0,0 +1,262 @@
+module;
+
+#include <GL/glew.h>
+
+#include <cassert>
+
+export module vis:render;
+
+import std;
+import :math;
+import :opengl;
+import :mesh;
+
+#ifdef NDEBUG
+#define CHECK_LAST_GL_CALL
+#else
+#define CHECK_LAST_GL_CALL                                                                                             \
+	do {                                                                                                                 \
+		auto err = glGetError();                                                                                           \
+		if (err) {                                                                                                         \
+			std::println("[{}][{}:{}] An OpenGL Error occurred", __FILE__, __func__, __LINE__);                              \
+			assert(err == 0);                                                                                                \
+		}                                                                                                                  \
+	} while (false)
+#endif
+
+export namespace vis::render {
+
+// Sort key layout, most significant first:
+// | layer: 8 | program: 12 | mesh: 24 | material: 20 |
+// Sorting on it groups the commands by layer, then by program and mesh, so the state changes are the minimum
+// regardless of the order the commands were submitted in.
+constexpr std::uint64_t make_sort_key(std::uint8_t layer, std::uint32_t program, std::uint32_t mesh,
+																			std::uint32_t material = 0) {
+	return (std::uint64_t{layer} << 56) | ((std::uint64_t{program} & 0xFFF) << 44) |
+				 ((std::uint64_t{mesh} & 0xFFFFFF) << 20) | (std::uint64_t{material} & 0xFFFFF);
+}
+
+struct DrawCommand {
+	std::uint64_t key;
+	const vis::opengl::Program* program;
+	vis::opengl::UniformHandle<vis::mat4> view_projection; // of program
+	const vis::mesh::Mesh* mesh;
+	vis::mesh::InstanceData instance;
+};
+
+// Commands are plain data, systems can fill the queue in any order. execute() sorts them once per frame and
+// turns every run of commands sharing program and mesh into a single instanced draw.
+// The programs must take the instanced vertex layout and a `view_projection` uniform, like
+// vis::shaders::instanced_vertex. The caller resolves that uniform once per program and submits its handle.
+class RenderQueue {
+public:
+	RenderQueue() = default;
+
+	RenderQueue(const RenderQueue&) = delete;
+	RenderQueue& operator=(const RenderQueue&) = delete;
+
+	RenderQueue(RenderQueue&&) = default;
+	RenderQueue& operator=(RenderQueue&&) = default;
+
+	void begin_frame(const vis::mat4& projection) {
+		view_projection = projection;
+		commands.clear();
+	}
+
+	void submit(std::uint8_t layer, const vis::opengl::Program& program,
+							vis::opengl::UniformHandle<vis::mat4> view_projection_uniform, const vis::mesh::Mesh& mesh,
+							const vis::mesh::InstanceData& instance, std::uint32_t material = 0) {
+		const auto key =
+				make_sort_key(layer, static_cast<GLuint>(program), static_cast<GLuint>(mesh.vertex_array()), material);
+		commands.push_back(DrawCommand{key, &program, view_projection_uniform, &mesh, instance});
+	}
+
+	void execute() {
+		sort();
+
+		const vis::opengl::Program* current_program = nullptr;
+		std::size_t run_begin = 0;
+		while (run_begin != sorted.size()) {
+			const auto& first = commands[sorted[run_begin].index];
+
+			instances.clear();
+			auto run_end = run_begin;
+			for (; run_end != sorted.size(); ++run_end) {
+				const auto& command = commands[sorted[run_end].index];
+				if (command.program != first.program or command.mesh != first.mesh) {
+					break;
+				}
+				instances.push_back(command.instance);
+			}
+
+			if (first.program != current_program) {
+				current_program = first.program;
+				current_program->use();
+				current_program->set(first.view_projection, view_projection);
+			}
+
+			instance_buffer.upload(instances);
+			first.mesh->draw_instanced(*current_program, instance_buffer);
+
+			run_begin = run_end;
+		}
+
+		commands.clear();
+	}
+
+	[[nodiscard]] std::size_t size() const {
+		return commands.size();
+	}
+
+private:
+	struct SortEntry {
+		std::uint64_t key;
+		std::uint32_t index;
+	};
+
+	// LSD radix sort on 8 bit digits, the digits that are the same for every key are skipped
+	void sort() {
+		sorted.resize(commands.size());
+		scratch.resize(commands.size());
+		for (std::uint32_t i = 0; i != commands.size(); ++i) {
+			sorted[i] = SortEntry{commands[i].key, i};
+		}
+
+		std::array<std::array<std::uint32_t, 256>, 8> histograms{};
+		for (const auto& entry : sorted) {
+			for (std::size_t digit = 0; digit != 8; ++digit) {
+				++histograms[digit][(entry.key >> (digit * 8)) & 0xFF];
+			}
+		}
+
+		for (std::size_t digit = 0; digit != 8; ++digit) {
+			auto& histogram = histograms[digit];
+			if (std::ranges::any_of(histogram, [&](auto count) { return count == sorted.size(); })) {
+				continue;
+			}
+
+			std::uint32_t offset = 0;
+			for (auto& count : histogram) {
+				offset += std::exchange(count, offset);
+			}
+
+			for (const auto& entry : sorted) {
+				scratch[histogram[(entry.key >> (digit * 8)) & 0xFF]++] = entry;
+			}
+			std::swap(sorted, scratch);
+		}
+	}
+
+private:
+	vis::mat4 view_projection{1.0f};
+	std::vector<DrawCommand> commands;
+	std::vector<SortEntry> sorted;
+	std::vector<SortEntry> scratch;
+	std::vector<vis::mesh::InstanceData> instances;
+	vis::mesh::InstanceBuffer instance_buffer;
+};
+
+// Draws the whole scene with a single glMultiDrawElementsIndirect: the meshes are copied once in a shared
+// vis::mesh::MeshPool, the instances are grouped per mesh in one instance buffer and every mesh becomes one indirect
+// command whose base instance points at its group.
+// Without ARB_multi_draw_indirect (a plain 4.1 context) the same commands are issued one instanced draw each, moving
+// the instance attributes to the group since there is no base instance either.
+// The program must take the instanced vertex layout, like vis::shaders::instanced_vertex, the caller sets its uniforms.
+class MultiDrawRenderer {
+public:
+	MultiDrawRenderer()
+			: indirect_buffer{GL_DRAW_INDIRECT_BUFFER},
+				multi_draw_indirect{vis::opengl::renderer_supports_multi_draw_indirect()} {}
+
+	MultiDrawRenderer(const MultiDrawRenderer&) = delete;
+	MultiDrawRenderer& operator=(const MultiDrawRenderer&) = delete;
+
+	void begin_frame() {
+		for (auto& group : groups) {
+			group.clear();
+		}
+	}
+
+	// The first submit of a mesh copies it in the pool, the mesh has to be a triangle list
+	void submit(const vis::mesh::Mesh& mesh, const vis::mesh::InstanceData& instance) {
+		auto [it, inserted] = slots.try_emplace(&mesh, 0);
+		if (inserted) {
+			it->second = pool.add(mesh);
+			groups.emplace_back();
+		}
+		groups[it->second].push_back(instance);
+	}
+
+	void execute(const vis::opengl::Program& program) {
+		commands.clear();
+		instances.clear();
+		for (std::uint32_t slot = 0; slot != groups.size(); ++slot) {
+			const auto& group = groups[slot];
+			if (group.empty()) {
+				continue;
+			}
+
+			const auto& range = pool.range(slot);
+			commands.push_back(vis::opengl::DrawElementsIndirectCommand{
+					.count = range.index_count,
+					.instance_count = static_cast<GLuint>(group.size()),
+					.first_index = range.first_index,
+					.base_vertex = range.base_vertex,
+					.base_instance = static_cast<GLuint>(instances.size()),
+			});
+			instances.insert(instances.end(), group.begin(), group.end());
+		}
+
+		if (commands.empty()) {
+			return;
+		}
+
+		instance_buffer.upload(instances);
+		pool.bind();
+		program.use();
+
+		if (multi_draw_indirect) {
+			if (not instances_attached) {
+				vis::mesh::attach_instance_attributes(instance_buffer);
+				instances_attached = true;
+			}
+
+			const auto size_in_bytes = commands.size() * sizeof(vis::opengl::DrawElementsIndirectCommand);
+			indirect_buffer.bind();
+			indirect_buffer.data(size_in_bytes, commands.data(), GL_STREAM_DRAW);
+			glMultiDrawElementsIndirect(GL_TRIANGLES, pool.index_type(), nullptr, static_cast<GLsizei>(commands.size()), 0);
+			CHECK_LAST_GL_CALL;
+			return;
+		}
+
+		for (const auto& command : commands) {
+			vis::mesh::attach_instance_attributes(instance_buffer, command.base_instance);
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(command.count), pool.index_type(),
+																				reinterpret_cast<void*>(command.first_index * pool.index_size()),
+																				static_cast<GLsizei>(command.instance_count), command.base_vertex);
+			CHECK_LAST_GL_CALL;
+		}
+	}
+
+	[[nodiscard]] bool uses_multi_draw_indirect() const {
+		return multi_draw_indirect;
+	}
+
+	// Draw calls issued by the last execute
+	[[nodiscard]] std::size_t draw_calls() const {
+		return multi_draw_indirect ? (commands.empty() ? 0 : 1) : commands.size();
+	}
+
+private:
+	vis::mesh::MeshPool pool;
+	std::unordered_map<const vis::mesh::Mesh*, std::uint32_t> slots;
+	std::vector<std::vector<vis::mesh::InstanceData>> groups;
+	std::vector<vis::mesh::InstanceData> instances;
+	std::vector<vis::opengl::DrawElementsIndirectCommand> commands;
+	vis::mesh::InstanceBuffer instance_buffer;
+	vis::opengl::VertexBufferObject indirect_buffer;
+	bool multi_draw_indirect;
+	bool instances_attached = false;
+};
+
+} // namespace vis::render
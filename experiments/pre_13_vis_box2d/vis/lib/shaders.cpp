@@ -0,0 +1,106 @@
+export module vis:shaders;
+
+import std;
+
+// TODO: load this from file or even better, build using SPRIV during compilation time
+export namespace vis::shaders {
+
+// One draw per mesh, the whole transformation is sent as a uniform
+constexpr std::string_view mesh_vertex = R"(
+#version 410 core
+layout (location = 0) in vec2 pos;
+layout (location = 1) in vec4 col;
+
+uniform mat4 model_view_projection;
+
+out vec4 vertex_color;
+
+void main()
+{
+    gl_Position = model_view_projection * vec4(pos.xy, 0.0f, 1.0f);
+		vertex_color = col;
+}
+)";
+
+// One draw per unique mesh, the transformation and the color come from vis::mesh::InstanceData
+constexpr std::string_view instanced_vertex = R"(
+#version 410 core
+layout (location = 0) in vec2 pos;
+layout (location = 1) in vec4 col;
+layout (location = 2) in vec4 instance_transform;
+layout (location = 3) in vec2 instance_scale;
+layout (location = 4) in vec4 instance_color;
+
+uniform mat4 view_projection;
+
+out vec4 vertex_color;
+
+void main()
+{
+    vec2 scaled = pos * instance_scale;
+    vec2 rotated = vec2(instance_transform.z * scaled.x - instance_transform.w * scaled.y,
+                        instance_transform.w * scaled.x + instance_transform.z * scaled.y);
+    gl_Position = view_projection * vec4(rotated + instance_transform.xy, 0.0f, 1.0f);
+    vertex_color = col * instance_color;
+}
+)";
+
+// vis::mesh::MeshLibrary::circle quads, instanced like instanced_vertex. The quad corners are passed on as the position
+// inside the unit circle
+constexpr std::string_view instanced_circle_vertex = R"(
+#version 410 core
+layout (location = 0) in vec2 pos;
+layout (location = 1) in vec4 col;
+layout (location = 2) in vec4 instance_transform;
+layout (location = 3) in vec2 instance_scale;
+layout (location = 4) in vec4 instance_color;
+
+uniform mat4 view_projection;
+
+out vec4 vertex_color;
+out vec2 local_position;
+
+void main()
+{
+    vec2 scaled = pos * instance_scale;
+    vec2 rotated = vec2(instance_transform.z * scaled.x - instance_transform.w * scaled.y,
+                        instance_transform.w * scaled.x + instance_transform.z * scaled.y);
+    gl_Position = view_projection * vec4(rotated + instance_transform.xy, 0.0f, 1.0f);
+    vertex_color = col * instance_color;
+    local_position = pos;
+}
+)";
+
+// Signed distance to the unit circle, the edge fades over one pixel whatever the zoom. The fade is kept inside the
+// circle, so the quad never clips it. Needs alpha blending.
+constexpr std::string_view circle_fragment = R"(
+#version 410 core
+
+in vec4 vertex_color;
+in vec2 local_position;
+out vec4 fragment_color;
+
+void main()
+{
+    float distance = length(local_position) - 1.0f;
+    float coverage = clamp(-distance / fwidth(distance), 0.0f, 1.0f);
+    if (coverage == 0.0f) {
+        discard;
+    }
+    fragment_color = vec4(vertex_color.rgb, vertex_color.a * coverage);
+}
+)";
+
+constexpr std::string_view color_fragment = R"(
+#version 410 core
+
+in vec4 vertex_color;
+out vec4 fragment_color;
+
+void main()
+{
+		fragment_color = vertex_color;
+}
+)";
+
+} // namespace vis::shaders
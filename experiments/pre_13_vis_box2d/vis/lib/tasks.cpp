@@ -0,0 +1,224 @@
+export module vis:tasks;
+
+import std;
+
+export namespace vis::tasks {
+
+// Same signature as Box2D's b2TaskCallback, so the world callbacks can be forwarded as they are
+using RangeFunction = void(std::int32_t begin, std::int32_t end, std::uint32_t worker, void* context);
+
+// A range split in chunks, over when every chunk has run
+class Task {
+public:
+	Task(RangeFunction* function, void* context, std::int32_t chunk_count)
+			: function{function}, context{context}, pending{chunk_count} {}
+
+	[[nodiscard]] bool is_done() const {
+		return pending.load(std::memory_order_acquire) == 0;
+	}
+
+private:
+	friend class TaskSystem;
+
+	RangeFunction* function;
+	void* context;
+	std::atomic<std::int32_t> pending;
+};
+
+// Thread pool with one chunk queue per worker: a worker takes from the back of its own queue and, when that is
+// empty, steals from the front of the others. Worker 0 is the thread calling enqueue and wait, which runs chunks
+// while it waits; only one thread at a time may play that role.
+class TaskSystem {
+public:
+	explicit TaskSystem(std::uint32_t worker_count = std::max(1u, std::thread::hardware_concurrency())) {
+		worker_count = std::max(worker_count, 1u);
+		for (std::uint32_t i = 0; i != worker_count; ++i) {
+			queues.push_back(std::make_unique<Queue>());
+		}
+		for (std::uint32_t worker = 1; worker != worker_count; ++worker) {
+			threads.emplace_back([this, worker](std::stop_token stop) { run_worker(stop, worker); });
+		}
+	}
+
+	~TaskSystem() {
+		for (auto& thread : threads) {
+			thread.request_stop();
+		}
+		wake.notify_all();
+	}
+
+	TaskSystem(const TaskSystem&) = delete;
+	TaskSystem& operator=(const TaskSystem&) = delete;
+
+	[[nodiscard]] std::uint32_t worker_count() const {
+		return static_cast<std::uint32_t>(queues.size());
+	}
+
+	// Splits [0, count) in chunks of at least min_range items spread over the other workers, worker 0 only steals them
+	// while it waits. A single item is queued as any other range: Box2D hands each of its solver workers over as a
+	// task of one item, they must run side by side. Without other workers the range runs right away and nullptr is
+	// returned, as Box2D expects from its enqueue callback.
+	Task* enqueue(RangeFunction* function, std::int32_t count, std::int32_t min_range, void* context) {
+		if (count <= 0) {
+			return nullptr;
+		}
+		if (worker_count() == 1) {
+			function(0, count, 0, context);
+			return nullptr;
+		}
+
+		min_range = std::max(min_range, 1);
+		const auto chunk_count =
+				std::clamp(count / min_range, 1, static_cast<std::int32_t>(worker_count()) * chunks_per_worker);
+		auto* task = new Task{function, context, chunk_count};
+		// chunk_count <= count, every chunk gets a non empty share, the sizes differ by one at most
+		for (std::int32_t chunk = 0; chunk != chunk_count; ++chunk) {
+			const auto begin = static_cast<std::int32_t>(std::int64_t{chunk} * count / chunk_count);
+			const auto end = static_cast<std::int32_t>(std::int64_t{chunk + 1} * count / chunk_count);
+			next_queue = next_queue % (queues.size() - 1) + 1;
+			auto& queue = *queues[next_queue];
+			const std::scoped_lock lock{queue.mutex};
+			queue.chunks.push_back(Chunk{task, begin, end});
+		}
+
+		{
+			const std::scoped_lock lock{sleep_mutex};
+			queued += chunk_count;
+		}
+		wake.notify_all();
+		return task;
+	}
+
+	// Runs chunks, of this task or any other, until the task is over, then releases it
+	void wait(Task* task) {
+		if (task == nullptr) {
+			return;
+		}
+
+		while (not task->is_done()) {
+			if (not run_one(0)) {
+				std::this_thread::yield();
+			}
+		}
+		delete task;
+	}
+
+	// fn(begin, end, worker) over [0, count), returns when every item is done
+	template <typename Fn> void parallel_for(std::int32_t count, std::int32_t min_range, Fn&& fn) {
+		auto* task = enqueue(
+				[](std::int32_t begin, std::int32_t end, std::uint32_t worker, void* context) {
+					(*static_cast<std::remove_reference_t<Fn>*>(context))(begin, end, worker);
+				},
+				count, min_range, &fn);
+		wait(task);
+	}
+
+private:
+	struct Chunk {
+		Task* task;
+		std::int32_t begin;
+		std::int32_t end;
+	};
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque<Chunk> chunks;
+	};
+
+	static constexpr std::int32_t chunks_per_worker = 4;
+
+	[[nodiscard]] std::optional<Chunk> take(std::uint32_t worker) {
+		{
+			auto& own = *queues[worker];
+			const std::scoped_lock lock{own.mutex};
+			if (not own.chunks.empty()) {
+				const auto chunk = own.chunks.back();
+				own.chunks.pop_back();
+				return chunk;
+			}
+		}
+
+		for (std::size_t i = 1; i != queues.size(); ++i) {
+			auto& victim = *queues[(worker + i) % queues.size()];
+			const std::scoped_lock lock{victim.mutex};
+			if (not victim.chunks.empty()) {
+				const auto chunk = victim.chunks.front();
+				victim.chunks.pop_front();
+				return chunk;
+			}
+		}
+
+		return std::nullopt;
+	}
+
+	bool run_one(std::uint32_t worker) {
+		const auto chunk = take(worker);
+		if (not chunk) {
+			return false;
+		}
+
+		{
+			const std::scoped_lock lock{sleep_mutex};
+			--queued;
+		}
+
+		chunk->task->function(chunk->begin, chunk->end, worker, chunk->task->context);
+		chunk->task->pending.fetch_sub(1, std::memory_order_release);
+		return true;
+	}
+
+	void run_worker(std::stop_token stop, std::uint32_t worker) {
+		while (not stop.stop_requested()) {
+			if (run_one(worker)) {
+				continue;
+			}
+
+			std::unique_lock lock{sleep_mutex};
+			wake.wait(lock, stop, [&] { return queued > 0; });
+		}
+	}
+
+private:
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::size_t next_queue = 0; // last queue given a chunk, only touched by worker 0
+	std::mutex sleep_mutex;
+	std::condition_variable_any wake;
+	std::int64_t queued = 0; // chunks not taken yet, guarded by sleep_mutex
+	// last, so the workers are joined before the queues go away
+	std::vector<std::jthread> threads;
+};
+
+// Lock-free mailbox between one writer and one reader thread. The writer fills back() and publishes it, the reader
+// takes the latest published value with front(). Neither ever waits on the other: the writer always owns a free slot
+// and the reader skips the values published in between two reads.
+template <typename T> class TripleBuffer {
+public:
+	// Writer side, the slot still holds an older value, to be overwritten
+	[[nodiscard]] T& back() {
+		return slots[back_index];
+	}
+
+	void publish() {
+		back_index = middle.exchange(back_index | fresh, std::memory_order_acq_rel) & index_mask;
+	}
+
+	// Reader side, the latest published value or the same as the last call when nothing new was published. Stays
+	// valid until the next call
+	[[nodiscard]] const T& front() {
+		if (middle.load(std::memory_order_relaxed) & fresh) {
+			front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+		}
+		return slots[front_index];
+	}
+
+private:
+	static constexpr std::uint8_t index_mask = 0b011;
+	static constexpr std::uint8_t fresh = 0b100;
+
+	std::array<T, 3> slots{};
+	alignas(64) std::atomic<std::uint8_t> middle{1};
+	alignas(64) std::uint8_t back_index = 0;
+	alignas(64) std::uint8_t front_index = 2;
+};
+
+} // namespace vis::tasks
@@ -5,4 +5,9 @@ export import :ecs;
 export import :engine;
 export import :opengl;
 export import :mesh;
-export import :physic;
\ No newline at end of file
+export import :physic;
+export import :shaders;
+export import :batch;
+export import :render;
+export import :profile;
+export import :tasks;
\ No newline at end of file